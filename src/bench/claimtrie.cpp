@@ -0,0 +1,269 @@
+// Copyright (c) 2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <claimtrie.h>
+#include <nameclaim.h>
+#include <prefixtrie.h>
+#include <random.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// a bit over a million names for the prefix trie, fewer claims where the trie gets hashed or written
+static const std::size_t PREFIX_TRIE_NAMES = 1 << 20;
+static const std::size_t CLAIM_TRIE_CLAIMS = 100000;
+static const std::size_t CLAIMS_PER_BLOCK = 1000;
+
+// short lower case names, so plenty of them share prefixes like the names on chain do
+static std::vector<std::string> SyntheticNames(std::size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string name(1 + rng.randrange(16), ' ');
+        for (auto& c : name)
+            c = 'a' + rng.randrange(26);
+        names.push_back(std::move(name));
+    }
+    return names;
+}
+
+static CClaimValue SyntheticClaim(std::size_t i)
+{
+    CClaimValue claim;
+    claim.outPoint = COutPoint(ArithToUint256(arith_uint256(i + 1)), i % 4);
+    claim.claimId = ClaimIdHash(claim.outPoint.hash, claim.outPoint.n);
+    claim.nAmount = 1 + i % 1000;
+    claim.nEffectiveAmount = claim.nAmount;
+    return claim;
+}
+
+class CClaimTrieCacheBench : public CClaimTrieCache
+{
+public:
+    // hashed the way the current chain is, all claims in the merkle tree
+    explicit CClaimTrieCacheBench(CClaimTrie* base) : CClaimTrieCache(base)
+    {
+        nNextHeight = std::max<int>(nNextHeight, Params().GetConsensus().nAllClaimsInMerkleForkHeight);
+    }
+
+    using CClaimTrieCache::insertClaimIntoTrie;
+
+    int nextHeight() const
+    {
+        return nNextHeight;
+    }
+
+    void fill(const std::vector<std::string>& names)
+    {
+        for (std::size_t i = 0; i < names.size(); ++i)
+            insertClaimIntoTrie(names[i], SyntheticClaim(i), false);
+    }
+};
+
+static void PrefixTrieInsert(benchmark::State& state)
+{
+    const auto names = SyntheticNames(PREFIX_TRIE_NAMES);
+    while (state.KeepRunning()) {
+        CPrefixTrie<std::string, CClaimTrieData> trie;
+        for (auto& name : names)
+            trie.insert(name, CClaimTrieData{});
+    }
+}
+
+static void PrefixTrieFind(benchmark::State& state)
+{
+    const auto names = SyntheticNames(PREFIX_TRIE_NAMES);
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    for (auto& name : names)
+        trie.insert(name, CClaimTrieData{});
+
+    std::size_t found = 0;
+    while (state.KeepRunning())
+        for (auto& name : names)
+            found += bool(trie.find(name));
+    assert(found);
+}
+
+// erasing needs a full trie every time, compare with PrefixTrieInsert
+static void PrefixTrieErase(benchmark::State& state)
+{
+    const auto names = SyntheticNames(PREFIX_TRIE_NAMES);
+    while (state.KeepRunning()) {
+        CPrefixTrie<std::string, CClaimTrieData> trie;
+        for (auto& name : names)
+            trie.insert(name, CClaimTrieData{});
+        for (auto& name : names)
+            trie.erase(name);
+        assert(trie.empty());
+    }
+}
+
+static void PrefixTrieIterate(benchmark::State& state)
+{
+    const auto names = SyntheticNames(PREFIX_TRIE_NAMES);
+    CPrefixTrie<std::string, CClaimTrieData> trie;
+    for (auto& name : names)
+        trie.insert(name, CClaimTrieData{});
+
+    std::size_t nodes = 0;
+    while (state.KeepRunning())
+        for (auto it = trie.begin(); it != trie.end(); ++it)
+            nodes += it.key().size();
+    assert(nodes);
+}
+
+// adding a block of new claims and getting them into the trie, the way ConnectBlock does
+static void ClaimTrieCacheBlock(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const auto names = SyntheticNames(CLAIM_TRIE_CLAIMS);
+    CClaimTrie trie(true, false, 1);
+
+    std::size_t i = 0;
+    while (state.KeepRunning()) {
+        CClaimTrieCacheBench cache(&trie);
+        const int nHeight = cache.nextHeight();
+        for (std::size_t n = 0; n < CLAIMS_PER_BLOCK; ++n, ++i) {
+            auto claim = SyntheticClaim(i);
+            cache.addClaim(names[i % names.size()], claim.outPoint, claim.claimId, claim.nAmount, nHeight);
+        }
+        insertUndoType insertUndo, insertSupportUndo;
+        claimQueueRowType expireUndo;
+        supportQueueRowType expireSupportUndo;
+        std::vector<std::pair<std::string, int>> takeoverHeightUndo;
+        cache.incrementBlock(insertUndo, expireUndo, insertSupportUndo, expireSupportUndo, takeoverHeightUndo);
+        cache.getMerkleHash();
+        cache.flush();
+    }
+}
+
+static void ClaimTrieMerkleHashFull(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench cache(&trie);
+    cache.fill(SyntheticNames(CLAIM_TRIE_CLAIMS));
+    cache.flush();
+
+    while (state.KeepRunning()) {
+        for (auto it = trie.begin(); it != trie.end(); ++it)
+            it->hash.SetNull();
+        CClaimTrieCacheBench(&trie).getMerkleHash();
+    }
+}
+
+// a block's worth of changed names on top of a hashed trie
+static void ClaimTrieMerkleHashIncremental(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const auto names = SyntheticNames(CLAIM_TRIE_CLAIMS);
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench filled(&trie);
+    filled.fill(names);
+    filled.flush();
+
+    std::size_t i = names.size();
+    while (state.KeepRunning()) {
+        CClaimTrieCacheBench cache(&trie);
+        for (std::size_t n = 0; n < CLAIMS_PER_BLOCK; ++n, ++i)
+            cache.insertClaimIntoTrie(names[i % names.size()], SyntheticClaim(i), false);
+        cache.getMerkleHash();
+    }
+}
+
+static void ClaimTrieProofForName(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const auto names = SyntheticNames(CLAIM_TRIE_CLAIMS);
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench cache(&trie);
+    cache.fill(names);
+    cache.flush();
+
+    std::size_t i = 0;
+    while (state.KeepRunning()) {
+        CClaimTrieProof proof;
+        cache.getProofForName(names[i++ % names.size()], proof);
+        assert(proof.hasValue);
+    }
+}
+
+static void ClaimTrieReadFromDisk(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheBench cache(&trie);
+    cache.fill(SyntheticNames(CLAIM_TRIE_CLAIMS));
+    CBlockIndex tip;
+    tip.nHeight = cache.nextHeight() - 1;
+    tip.hashClaimTrie = cache.getMerkleHash();
+    cache.flush();
+
+    while (state.KeepRunning()) {
+        bool read = CClaimTrieCache(&trie).ReadFromDisk(&tip);
+        assert(read);
+    }
+}
+
+// names as they come in claims: mixed case ascii mostly, some utf-8
+static std::vector<std::string> SyntheticClaimNames(std::size_t count, bool fUnicode)
+{
+    static const char* const letters[] = {"\xC3\xA9", "\xC3\x9C", "\xD0\x96", "\xCE\xA9", "\xE3\x81\xB6"};
+    FastRandomContext rng(true);
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string name;
+        for (auto n = 4 + rng.randrange(24); n; --n)
+            name += (rng.randbool() ? 'A' : 'a') + rng.randrange(26);
+        if (fUnicode)
+            name.insert(rng.randrange(name.size()), letters[rng.randrange(5)]);
+        names.push_back(std::move(name));
+    }
+    return names;
+}
+
+static void NormalizeNames(benchmark::State& state, bool fUnicode, std::size_t count)
+{
+    const auto names = SyntheticClaimNames(count, fUnicode);
+    std::size_t i = 0, size = 0;
+    while (state.KeepRunning())
+        size += CClaimTrieCacheNormalizationFork::normalizeName(names[i++ % names.size()]).size();
+    assert(size);
+}
+
+static void NormalizeNameAscii(benchmark::State& state)
+{
+    NormalizeNames(state, false, 100000);
+}
+
+// the same few names over and over, like the claims and supports of a block and the lookups of its names
+static void NormalizeNameUnicodeRepeated(benchmark::State& state)
+{
+    NormalizeNames(state, true, 1000);
+}
+
+static void NormalizeNameUnicodeDistinct(benchmark::State& state)
+{
+    NormalizeNames(state, true, 1000000);
+}
+
+BENCHMARK(PrefixTrieInsert, 1);
+BENCHMARK(PrefixTrieFind, 1);
+BENCHMARK(PrefixTrieErase, 1);
+BENCHMARK(PrefixTrieIterate, 2);
+BENCHMARK(ClaimTrieCacheBlock, 50);
+BENCHMARK(ClaimTrieMerkleHashFull, 2);
+BENCHMARK(ClaimTrieMerkleHashIncremental, 100);
+BENCHMARK(ClaimTrieProofForName, 50000);
+BENCHMARK(ClaimTrieReadFromDisk, 1);
+BENCHMARK(NormalizeNameAscii, 100000);
+BENCHMARK(NormalizeNameUnicodeRepeated, 100000);
+BENCHMARK(NormalizeNameUnicodeDistinct, 100000);
@@ -241,3 +241,28 @@ void UpdateCache(const CTransaction& tx, CClaimTrieCache& trieCache, const CCoin
         ProcessClaim(addClaim, trieCache, txout.scriptPubKey);
     }
 }
+
+std::vector<std::string> ClaimNamesInBlock(const CBlock& block, const CClaimTrieCache& trieCache, const CCoinsViewCache& view)
+{
+    std::vector<std::string> names;
+    const auto addName = [&names, &trieCache](const CScript& scriptPubKey) {
+        int op;
+        std::vector<std::vector<unsigned char> > vvchParams;
+        if (DecodeClaimScript(scriptPubKey, op, vvchParams, trieCache.allowSupportMetadata()))
+            names.push_back(vchToString(vvchParams[0]));
+    };
+
+    for (auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        // outputs spent within the block aren't in the view yet, they are among the outputs anyway
+        for (auto& txin : tx->vin) {
+            const Coin& coin = view.AccessCoin(txin.prevout);
+            if (!coin.IsSpent())
+                addName(coin.out.scriptPubKey);
+        }
+        for (auto& txout : tx->vout)
+            addName(txout.scriptPubKey);
+    }
+    return names;
+}
@@ -8,6 +8,7 @@
 #include "amount.h"
 #include "claimtrie.h"
 #include "hash.h"
+#include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "uint256.h"
@@ -242,4 +243,12 @@ struct CUpdateCacheCallbacks
  */
 void UpdateCache(const CTransaction& tx, CClaimTrieCache& trieCache, const CCoinsViewCache& view, int nHeight, const CUpdateCacheCallbacks& callbacks = {});
 
+/**
+ * Function to list the names the claim scripts of a block touch, ahead of UpdateCache
+ * @param[in]  block            block about to be connected
+ * @param[in]  trieCache        trie the block is applied to
+ * @param[in]  view             coins cache with the outputs the block spends
+ */
+std::vector<std::string> ClaimNamesInBlock(const CBlock& block, const CClaimTrieCache& trieCache, const CCoinsViewCache& view);
+
 #endif // CLAIMSCRIPTOP_H
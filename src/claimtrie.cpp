@@ -1,12 +1,22 @@
 
+#include <checkqueue.h>
 #include <claimtrie.h>
 #include <coins.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <logging.h>
+#include <streams.h>
 #include <util.h>
 
 #include <algorithm>
+#include <limits>
 #include <memory>
+#include <mutex>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 extern const uint256 one = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
 
@@ -20,6 +30,13 @@ std::vector<unsigned char> heightToVch(int n)
     return vchHeight;
 }
 
+uint160 hexOrderedClaimId(const uint160& claimId)
+{
+    uint160 ordered;
+    std::reverse_copy(claimId.begin(), claimId.end(), ordered.begin());
+    return ordered;
+}
+
 uint256 getValueHash(const COutPoint& outPoint, int nHeightOfLastTakeover)
 {
     CHash256 hasher;
@@ -79,6 +96,51 @@ bool eraseOutPoint(std::vector<T>& cont, const C& point, T* value = nullptr)
     return true;
 }
 
+const uint256& CClaimValue::getValueHash(int nHeightOfLastTakeover)
+{
+    if (nValueHashTakeover != nHeightOfLastTakeover) {
+        valueHash = ::getValueHash(outPoint, nHeightOfLastTakeover);
+        nValueHashTakeover = nHeightOfLastTakeover;
+    }
+    return valueHash;
+}
+
+const std::vector<uint256>& CClaimTrieData::getClaimHashes()
+{
+    bool fChanged = claimHashes.size() != claims.size();
+    claimHashes.resize(claims.size());
+    for (std::size_t i = 0; i < claims.size(); ++i) {
+        auto& hash = claims[i].getValueHash(nHeightOfLastTakeover);
+        if (claimHashes[i] != hash) {
+            claimHashes[i] = hash;
+            fChanged = true;
+        }
+    }
+    if (fChanged)
+        claimsMerkleRoot = ComputeMerkleRoot(claimHashes);
+    return claimHashes;
+}
+
+const uint256& CClaimTrieData::getClaimsMerkleRoot()
+{
+    getClaimHashes();
+    return claimsMerkleRoot;
+}
+
+std::vector<uint256> CClaimTrieData::getClaimHashes() const
+{
+    std::vector<uint256> hashes;
+    hashes.reserve(claims.size());
+    for (auto& claim : claims)
+        hashes.push_back(::getValueHash(claim.outPoint, nHeightOfLastTakeover));
+    return hashes;
+}
+
+uint256 CClaimTrieData::getClaimsMerkleRoot() const
+{
+    return ComputeMerkleRoot(getClaimHashes());
+}
+
 bool CClaimTrieData::insertClaim(const CClaimValue& claim)
 {
     claims.push_back(claim);
@@ -124,36 +186,142 @@ void CClaimTrieData::reorderClaims(const supportEntryType& supports)
     std::sort(claims.rbegin(), claims.rend());
 }
 
-CClaimTrie::CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor, std::size_t cacheMB)
+CClaimTrie::CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor, std::size_t cacheMB, int nHistoryDepth, bool fRanking)
+    : nHistoryDepth(std::max(nHistoryDepth, 0)), fRanking(fRanking)
 {
     nProportionalDelayFactor = proportionalDelayFactor;
     db.reset(new CDBWrapper(GetDataDir() / "claimtrie", cacheMB * 1024ULL * 1024ULL, fMemory, fWipe, false));
+
+    // history is only complete from the height it was last turned on at, what is left from before goes
+    if (!this->nHistoryDepth) {
+        CDBBatch batch(*db);
+        batch.Erase(std::make_pair(TRIE_HISTORY_START, std::string()));
+        pruneHistory(batch, std::numeric_limits<int>::max());
+        db->WriteBatch(batch);
+    } else if (!db->Read(std::make_pair(TRIE_HISTORY_START, std::string()), nHistoryStart))
+        nHistoryStart = -1;
+
+    // claim ids are looked up by their hex prefix through CLAIM_BY_HEX_ID, older databases only have CLAIM_BY_ID
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    std::pair<uint8_t, uint160> key;
+    pcursor->Seek(std::make_pair(CLAIM_BY_HEX_ID, uint160()));
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != CLAIM_BY_HEX_ID) {
+        CDBBatch batch(*db);
+        for (pcursor->Seek(std::make_pair(CLAIM_BY_ID, uint160())); pcursor->Valid(); pcursor->Next()) {
+            if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID)
+                break;
+            batch.Write(std::make_pair(CLAIM_BY_HEX_ID, hexOrderedClaimId(key.second)), key.second);
+        }
+        if (batch.SizeEstimate()) {
+            LogPrintf("Indexing claim ids by prefix...\n");
+            db->WriteBatch(batch, true);
+        }
+    }
+
+    publishSnapshot();
+}
+
+bool CClaimTrie::findHistory(const std::vector<unsigned char>& key, int nHeight, std::vector<unsigned char>& value) const
+{
+    // the first change recorded after nHeight holds the value the entry had at nHeight
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    pcursor->Seek(std::make_pair(TRIE_HISTORY, std::make_pair(key, heightToVch(nHeight + 1))));
+    std::pair<uint8_t, std::pair<std::vector<unsigned char>, std::vector<unsigned char>>> historyKey;
+    if (!pcursor->Valid() || !pcursor->GetKey(historyKey) || historyKey.first != TRIE_HISTORY || historyKey.second.first != key)
+        return false;
+    return pcursor->GetValue(value);
+}
+
+void CClaimTrie::pruneHistory(CDBBatch& batch, int nHeight) const
+{
+    // the heights are big endian in the row keys, so the rows come oldest first
+    const auto vchHeight = heightToVch(nHeight);
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    for (pcursor->Seek(std::make_pair(TRIE_HISTORY_ROW, heightToVch(0))); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, std::vector<unsigned char>> key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_HISTORY_ROW || key.second > vchHeight)
+            break;
+        std::vector<std::vector<unsigned char>> keys;
+        if (pcursor->GetValue(keys))
+            for (auto& entry : keys)
+                batch.Erase(std::make_pair(TRIE_HISTORY, std::make_pair(entry, key.second)));
+        batch.Erase(key);
+    }
 }
 
 bool CClaimTrie::SyncToDisk()
 {
-    return db && db->Sync();
+    return db && writePending() && db->Sync();
+}
+
+void CClaimTrie::setWriteBuffer(std::size_t nBytes)
+{
+    // the history is read straight from the database
+    nWriteBuffer = nHistoryDepth ? 0 : nBytes;
+}
+
+bool CClaimTrie::write(CDBBatch& batch)
+{
+    if (!nWriteBuffer && pending.empty()) {
+        auto ret = db->WriteBatch(batch);
+        publishSnapshot();
+        return ret;
+    }
+    batch.ForEach([this](const leveldb::Slice& key, const leveldb::Slice* value) {
+        // map node and string headers included, roughly
+        static const std::size_t nEntryOverhead = 128;
+        auto it = pending.emplace(key.ToString(), std::string());
+        if (it.second)
+            nPendingBytes += nEntryOverhead + key.size();
+        else
+            nPendingBytes -= it.first->second.size();
+        if (value)
+            it.first->second.assign(value->data(), value->size());
+        else
+            it.first->second.clear();
+        nPendingBytes += it.first->second.size();
+    });
+    return nPendingBytes < nWriteBuffer || writePending();
+}
+
+bool CClaimTrie::writePending()
+{
+    if (pending.empty())
+        return true;
+    CDBBatch batch(*db);
+    for (auto& entry : pending) {
+        if (entry.second.empty())
+            batch.EraseRaw(entry.first);
+        else
+            batch.WriteRaw(entry.first, entry.second);
+    }
+    LogPrint(BCLog::CLAIMS, "Writing %zu buffered claim trie entries (%zu bytes)\n", pending.size(), batch.SizeEstimate());
+    auto ret = db->WriteBatch(batch);
+    pending.clear();
+    nPendingBytes = 0;
+    publishSnapshot();
+    return ret;
 }
 
 template <typename T>
 using rm_ref = typename std::remove_reference<T>::type;
 
 template <typename Key, typename Map>
-auto getRow(const CDBWrapper& db, uint8_t dbkey, const Key& key, Map& queue) -> COptional<rm_ref<decltype(queue.at(key))>>
+auto getRow(const CClaimTrie& trie, int nHeight, uint8_t dbkey, const Key& key, Map& queue) -> COptional<rm_ref<decltype(queue.at(key))>>
 {
     auto it = queue.find(key);
     if (it != queue.end())
         return {&(it->second)};
     typename Map::mapped_type row;
-    if (db.Read(std::make_pair(dbkey, key), row))
+    if (trie.read(std::make_pair(dbkey, key), row, nHeight))
         return {std::move(row)};
     return {};
 }
 
 template <typename Key, typename Value>
-Value* getQueue(const CDBWrapper& db, uint8_t dbkey, const Key& key, std::map<Key, Value>& queue, bool create)
+Value* getQueue(const CClaimTrie& trie, int nHeight, uint8_t dbkey, const Key& key, std::map<Key, Value>& queue, bool create)
 {
-    auto row = getRow(db, dbkey, key, queue);
+    auto row = getRow(trie, nHeight, dbkey, key, queue);
     if (row.unique() || (!row && create)) {
         auto ret = queue.emplace(key, row ? std::move(*row) : Value{});
         assert(ret.second);
@@ -172,13 +340,13 @@ inline constexpr bool supportedType()
 template <>
 std::vector<queueEntryType<CClaimValue>>* CClaimTrieCacheBase::getQueueCacheRow(int nHeight, bool createIfNotExists)
 {
-    return getQueue(*(base->db), CLAIM_QUEUE_ROW, nHeight, claimQueueCache, createIfNotExists);
+    return getQueue(*base, nHistoryHeight, CLAIM_QUEUE_ROW, nHeight, claimQueueCache, createIfNotExists);
 }
 
 template <>
 std::vector<queueEntryType<CSupportValue>>* CClaimTrieCacheBase::getQueueCacheRow(int nHeight, bool createIfNotExists)
 {
-    return getQueue(*(base->db), SUPPORT_QUEUE_ROW, nHeight, supportQueueCache, createIfNotExists);
+    return getQueue(*base, nHistoryHeight, SUPPORT_QUEUE_ROW, nHeight, supportQueueCache, createIfNotExists);
 }
 
 template <typename T>
@@ -191,13 +359,13 @@ std::vector<queueEntryType<T>>* CClaimTrieCacheBase::getQueueCacheRow(int, bool)
 template <>
 COptional<const std::vector<queueEntryType<CClaimValue>>> CClaimTrieCacheBase::getQueueCacheRow(int nHeight) const
 {
-    return getRow(*(base->db), CLAIM_QUEUE_ROW, nHeight, claimQueueCache);
+    return getRow(*base, nHistoryHeight, CLAIM_QUEUE_ROW, nHeight, claimQueueCache);
 }
 
 template <>
 COptional<const std::vector<queueEntryType<CSupportValue>>> CClaimTrieCacheBase::getQueueCacheRow(int nHeight) const
 {
-    return getRow(*(base->db), SUPPORT_QUEUE_ROW, nHeight, supportQueueCache);
+    return getRow(*base, nHistoryHeight, SUPPORT_QUEUE_ROW, nHeight, supportQueueCache);
 }
 
 template <typename T>
@@ -210,13 +378,13 @@ COptional<const std::vector<queueEntryType<T>>> CClaimTrieCacheBase::getQueueCac
 template <>
 queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow<CClaimValue>(const std::string& name, bool createIfNoExists)
 {
-    return getQueue(*(base->db), CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache, createIfNoExists);
+    return getQueue(*base, nHistoryHeight, CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache, createIfNoExists);
 }
 
 template <>
 queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow<CSupportValue>(const std::string& name, bool createIfNoExists)
 {
-    return getQueue(*(base->db), SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache, createIfNoExists);
+    return getQueue(*base, nHistoryHeight, SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache, createIfNoExists);
 }
 
 template <typename T>
@@ -229,13 +397,13 @@ queueNameRowType* CClaimTrieCacheBase::getQueueCacheNameRow(const std::string&,
 template <>
 COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow<CClaimValue>(const std::string& name) const
 {
-    return getRow(*(base->db), CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache);
+    return getRow(*base, nHistoryHeight, CLAIM_QUEUE_NAME_ROW, name, claimQueueNameCache);
 }
 
 template <>
 COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow<CSupportValue>(const std::string& name) const
 {
-    return getRow(*(base->db), SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache);
+    return getRow(*base, nHistoryHeight, SUPPORT_QUEUE_NAME_ROW, name, supportQueueNameCache);
 }
 
 template <typename T>
@@ -248,13 +416,13 @@ COptional<const queueNameRowType> CClaimTrieCacheBase::getQueueCacheNameRow(cons
 template <>
 expirationQueueRowType* CClaimTrieCacheBase::getExpirationQueueCacheRow<CClaimValue>(int nHeight, bool createIfNoExists)
 {
-    return getQueue(*(base->db), CLAIM_EXP_QUEUE_ROW, nHeight, expirationQueueCache, createIfNoExists);
+    return getQueue(*base, nHistoryHeight, CLAIM_EXP_QUEUE_ROW, nHeight, expirationQueueCache, createIfNoExists);
 }
 
 template <>
 expirationQueueRowType* CClaimTrieCacheBase::getExpirationQueueCacheRow<CSupportValue>(int nHeight, bool createIfNoExists)
 {
-    return getQueue(*(base->db), SUPPORT_EXP_QUEUE_ROW, nHeight, supportExpirationQueueCache, createIfNoExists);
+    return getQueue(*base, nHistoryHeight, SUPPORT_EXP_QUEUE_ROW, nHeight, supportExpirationQueueCache, createIfNoExists);
 }
 
 template <typename T>
@@ -270,6 +438,19 @@ bool CClaimTrieCacheBase::haveClaim(const std::string& name, const COutPoint& ou
     return it && it->haveClaim(outPoint);
 }
 
+std::unique_ptr<CClaimTriePrefetch> CClaimTrieCacheBase::prefetch(const std::vector<std::string>& names) const
+{
+    std::vector<std::string> keys;
+    if (nClaimTrieHashThreads) {
+        keys.reserve(names.size());
+        for (auto& name : names)
+            keys.push_back(adjustNameForValidHeight(name, nNextHeight));
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    return std::unique_ptr<CClaimTriePrefetch>(new CClaimTriePrefetch(*base->db, std::move(keys)));
+}
+
 bool CClaimTrieCacheBase::haveSupport(const std::string& name, const COutPoint& outPoint) const
 {
     const auto supports = getSupportsForName(name);
@@ -283,7 +464,7 @@ supportEntryType CClaimTrieCacheBase::getSupportsForName(const std::string& name
         return sit->second;
 
     supportEntryType supports;
-    if (base->db->Read(std::make_pair(SUPPORT, name), supports)) // don't trust the try/catch in here
+    if (base->read(std::make_pair(SUPPORT, name), supports, nHistoryHeight)) // don't trust the try/catch in here
         return supports;
     return {};
 }
@@ -349,6 +530,62 @@ CAmount CClaimTrie::getTotalValueOfClaimsInTrie(bool fControllingOnly) const
     return value_in_subtrie;
 }
 
+std::vector<CSupportIndexElement> CClaimTrie::getSupportsForClaimId(const uint160& claimId)
+{
+    // the supports of a claim are next to each other, ordered by outpoint
+    std::vector<CSupportIndexElement> supports;
+    writePending();
+    std::unique_ptr<CDBIterator> pcursor(db->NewIterator());
+    for (pcursor->Seek(std::make_pair(SUPPORT_BY_CLAIM_ID, supportIndexKeyType(claimId, COutPoint(uint256(), 0)))); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, supportIndexKeyType> key;
+        if (!pcursor->GetKey(key) || key.first != SUPPORT_BY_CLAIM_ID || key.second.first != claimId)
+            break;
+        CSupportIndexElement element;
+        if (!pcursor->GetValue(element)) {
+            error("%s(): error reading the supports of claim %s", __func__, claimId.GetHex());
+            break;
+        }
+        supports.push_back(std::move(element));
+    }
+    return supports;
+}
+
+std::vector<std::pair<std::string, CAmount>> CClaimTrie::getTopClaims(std::size_t nStart, std::size_t nLimit) const
+{
+    std::vector<std::pair<std::string, CAmount>> result;
+    if (nStart >= topClaims.size())
+        return result;
+    auto it = std::next(topClaims.begin(), nStart);
+    for (; it != topClaims.end() && result.size() < nLimit; ++it)
+        result.emplace_back(*it->second, it->first);
+    return result;
+}
+
+void CClaimTrie::rankName(const std::string& name, const CClaimTrieData* data)
+{
+    if (!fRanking)
+        return;
+    // the claims are in bid order, the first one controls the name
+    const bool fRanked = data && !data->empty();
+    const CAmount nAmount = fRanked ? data->claims.front().nEffectiveAmount : 0;
+    auto it = controllingAmounts.find(name);
+    if (it != controllingAmounts.end()) {
+        if (fRanked && it->second == nAmount)
+            return;
+        topClaims.erase(std::make_pair(it->second, &it->first));
+        if (!fRanked) {
+            controllingAmounts.erase(it);
+            return;
+        }
+        it->second = nAmount;
+    } else if (fRanked) {
+        it = controllingAmounts.emplace(name, nAmount).first;
+    } else {
+        return;
+    }
+    topClaims.emplace(nAmount, &it->first);
+}
+
 bool CClaimTrieCacheBase::getInfoForName(const std::string& name, CClaimValue& claim) const
 {
     auto it = find(name);
@@ -367,20 +604,10 @@ void CClaimTrieCacheBase::insertRowsFromQueue(std::vector<T>& result, const std:
                         result.push_back(row.second);
 }
 
-CClaimSupportToName CClaimTrieCacheBase::getClaimsForName(const std::string& name) const
+// pair the supports up with the claims they support, whatever is left over is unmatched
+static CClaimSupportToName matchSupportsToClaims(const std::string& name, int nLastTakeoverHeight, const claimEntryType& claims, supportEntryType supports, int nNextHeight)
 {
-    claimEntryType claims;
-    int nLastTakeoverHeight = 0;
-    auto supports = getSupportsForName(name);
-    insertRowsFromQueue(supports, name);
-
-    if (auto it = find(name)) {
-        claims = it->claims;
-        nLastTakeoverHeight = it->nHeightOfLastTakeover;
-    }
-    insertRowsFromQueue(claims, name);
-
-    auto find = [&supports](decltype(supports)::iterator& it, const CClaimValue& claim) {
+    auto find = [&supports](supportEntryType::iterator& it, const CClaimValue& claim) {
         it = std::find_if(it, supports.end(), [&claim](const CSupportValue& support) {
             return claim.claimId == support.supportedClaimId;
         });
@@ -401,6 +628,341 @@ CClaimSupportToName CClaimTrieCacheBase::getClaimsForName(const std::string& nam
     return {name, nLastTakeoverHeight, std::move(claimsNsupports), std::move(supports)};
 }
 
+CClaimSupportToName CClaimTrieCacheBase::getClaimsForName(const std::string& name) const
+{
+    claimEntryType claims;
+    int nLastTakeoverHeight = 0;
+    auto supports = getSupportsForName(name);
+    insertRowsFromQueue(supports, name);
+
+    if (auto it = find(name)) {
+        claims = it->claims;
+        nLastTakeoverHeight = it->nHeightOfLastTakeover;
+    }
+    insertRowsFromQueue(claims, name);
+
+    return matchSupportsToClaims(name, nLastTakeoverHeight, claims, std::move(supports), nNextHeight);
+}
+
+CClaimsForNameView CClaimTrieCacheBase::viewClaimsForName(const std::string& name) const
+{
+    CClaimsForNameView view(name, nNextHeight);
+
+    auto sit = supportCache.find(name);
+    if (sit != supportCache.end()) {
+        for (auto& support : sit->second)
+            view.add(support);
+    } else {
+        supportEntryType supports;
+        if (base->read(std::make_pair(SUPPORT, name), supports, nHistoryHeight))
+            for (auto& support : view.hold(std::move(supports)))
+                view.add(support);
+    }
+    addRowsFromQueue<CSupportValue>(view, name);
+
+    if (auto it = find(name)) {
+        for (auto& claim : it->claims)
+            view.add(claim);
+        view.nLastTakeoverHeight = it->nHeightOfLastTakeover;
+    }
+    addRowsFromQueue<CClaimValue>(view, name);
+
+    return view;
+}
+
+template <typename T>
+void CClaimTrieCacheBase::addRowsFromQueue(CClaimsForNameView& view, const std::string& name) const
+{
+    supportedType<T>();
+    if (auto nameRows = getQueueCacheNameRow<T>(name))
+        for (auto& nameRow : *nameRows)
+            if (auto rows = getQueueCacheRow<T>(nameRow.nHeight))
+                for (auto& row : view.hold(std::move(rows)))
+                    if (row.first == name)
+                        view.add(row.second);
+}
+
+std::size_t CClaimsForNameView::find(const uint160& claimId) const
+{
+    auto it = std::find_if(claims.begin(), claims.end(), [&claimId](const CClaimValue* claim) {
+        return claim->claimId == claimId;
+    });
+    return std::distance(claims.begin(), it);
+}
+
+std::size_t CClaimsForNameView::find(const std::string& partialId) const
+{
+    // match against the hex the ids print as without printing them, GetHex starts from the last byte
+    static const char hexDigits[] = "0123456789abcdef";
+    auto it = std::find_if(claims.begin(), claims.end(), [&partialId](const CClaimValue* claim) {
+        if (partialId.size() > 2 * claim->claimId.size())
+            return false;
+        auto id = claim->claimId.end();
+        for (std::size_t i = 0; i < partialId.size(); ++i) {
+            auto byte = *(id - 1 - i / 2);
+            if (hexDigits[i % 2 ? byte & 0xf : byte >> 4] != std::tolower(partialId[i]))
+                return false;
+        }
+        return true;
+    });
+    return std::distance(claims.begin(), it);
+}
+
+CAmount CClaimsForNameView::effectiveAmount(std::size_t i) const
+{
+    CAmount nAmount = claims[i]->nValidAtHeight < nNextHeight ? claims[i]->nAmount : 0;
+    forEachSupport(i, [this, &nAmount](const CSupportValue& support) {
+        if (support.nValidAtHeight < nNextHeight)
+            nAmount += support.nAmount;
+    });
+    return nAmount;
+}
+
+CAmount CClaimsForNameView::fullAmount(std::size_t i) const
+{
+    CAmount nAmount = claims[i]->nAmount;
+    forEachSupport(i, [&nAmount](const CSupportValue& support) {
+        nAmount += support.nAmount;
+    });
+    return nAmount;
+}
+
+std::vector<std::size_t> CClaimsForNameView::seqOrder() const
+{
+    std::vector<std::size_t> order(claims.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs) {
+        auto& lc = *claims[lhs];
+        auto& rc = *claims[rhs];
+        return lc.nHeight < rc.nHeight || (lc.nHeight == rc.nHeight && lc.outPoint.n < rc.outPoint.n);
+    });
+    return order;
+}
+
+void AppendClaimTrieChanges(std::vector<CClaimTrieChange>& changes, const CClaimSupportToName& before, const CClaimSupportToName& after, int nHeight)
+{
+    const auto append = [&changes, &after](uint8_t type, const uint160& claimId, const COutPoint& outPoint, CAmount nAmount) {
+        CClaimTrieChange change;
+        change.type = type;
+        change.name = after.name;
+        change.claimId = claimId;
+        change.outPoint = outPoint;
+        change.nAmount = nAmount;
+        change.nEffectiveAmount = after.find(claimId).effectiveAmount;
+        changes.push_back(std::move(change));
+    };
+
+    // a claim keeps its id through updates, a support is only ever added or removed
+    for (auto& claimNsupports : after.claimsNsupports) {
+        auto& claim = claimNsupports.claim;
+        auto& previous = before.find(claim.claimId);
+        if (previous.IsNull())
+            append(CClaimTrieChange::CLAIM_ADDED, claim.claimId, claim.outPoint, claim.nAmount);
+        else if (previous.claim.outPoint != claim.outPoint)
+            append(CClaimTrieChange::CLAIM_UPDATED, claim.claimId, claim.outPoint, claim.nAmount);
+        else if (claim.nValidAtHeight == nHeight)
+            append(CClaimTrieChange::CLAIM_ACTIVATED, claim.claimId, claim.outPoint, claim.nAmount);
+    }
+    for (auto& claimNsupports : before.claimsNsupports) {
+        auto& claim = claimNsupports.claim;
+        if (after.find(claim.claimId).IsNull())
+            append(CClaimTrieChange::CLAIM_REMOVED, claim.claimId, claim.outPoint, claim.nAmount);
+    }
+
+    const auto allSupports = [](const CClaimSupportToName& claims) {
+        auto supports = claims.unmatchedSupports;
+        for (auto& claimNsupports : claims.claimsNsupports)
+            supports.insert(supports.end(), claimNsupports.supports.begin(), claimNsupports.supports.end());
+        return supports;
+    };
+    const auto supportsBefore = allSupports(before);
+    const auto supportsAfter = allSupports(after);
+    for (auto& support : supportsAfter) {
+        auto it = findOutPoint(supportsBefore, support.outPoint);
+        if (it == supportsBefore.end())
+            append(CClaimTrieChange::SUPPORT_ADDED, support.supportedClaimId, support.outPoint, support.nAmount);
+        else if (support.nValidAtHeight == nHeight)
+            append(CClaimTrieChange::SUPPORT_ACTIVATED, support.supportedClaimId, support.outPoint, support.nAmount);
+    }
+    for (auto& support : supportsBefore)
+        if (findOutPoint(supportsAfter, support.outPoint) == supportsAfter.end())
+            append(CClaimTrieChange::SUPPORT_REMOVED, support.supportedClaimId, support.outPoint, support.nAmount);
+
+    if (after.nLastTakeoverHeight != before.nLastTakeoverHeight) {
+        auto& controlling = after.claimsNsupports.empty() || after.claimsNsupports[0].claim.nValidAtHeight > nHeight
+            ? invalid : after.claimsNsupports[0];
+        append(CClaimTrieChange::TAKEOVER, controlling.claim.claimId, controlling.claim.outPoint, controlling.claim.nAmount);
+    }
+}
+
+CClaimTrieSnapshot::CClaimTrieSnapshot(const CDBWrapper& db, int nNextHeight) : nNextHeight(nNextHeight), db(db)
+{
+}
+
+template <typename T>
+void CClaimTrieSnapshot::insertRowsFromQueue(std::vector<T>& result, const std::string& name, uint8_t nameRowKey, uint8_t rowKey) const
+{
+    supportedType<T>();
+    queueNameRowType nameRows;
+    if (!db.Read(std::make_pair(nameRowKey, name), nameRows))
+        return;
+    for (auto& nameRow : nameRows) {
+        std::vector<queueEntryType<T>> rows;
+        if (db.Read(std::make_pair(rowKey, nameRow.nHeight), rows))
+            for (auto& row : rows)
+                if (row.first == name)
+                    result.push_back(std::move(row.second));
+    }
+}
+
+CClaimSupportToName CClaimTrieSnapshot::getClaimsForName(const std::string& name) const
+{
+    // same lookup as the cache does at this height, only read from the snapshot
+    const auto normalized = nNextHeight > Params().GetConsensus().nNormalizedNameForkHeight
+        ? CClaimTrieCacheNormalizationFork::normalizeName(name) : name;
+
+    supportEntryType supports;
+    db.Read(std::make_pair(SUPPORT, normalized), supports);
+    insertRowsFromQueue(supports, normalized, SUPPORT_QUEUE_NAME_ROW, SUPPORT_QUEUE_ROW);
+
+    CClaimTrieData data;
+    db.Read(std::make_pair(TRIE_NODE, normalized), data);
+    insertRowsFromQueue(data.claims, normalized, CLAIM_QUEUE_NAME_ROW, CLAIM_QUEUE_ROW);
+
+    return matchSupportsToClaims(normalized, data.nHeightOfLastTakeover, data.claims, std::move(supports), nNextHeight);
+}
+
+template <typename T>
+void CClaimTrieSnapshot::addRowsFromQueue(CClaimsForNameView& view, const std::string& name, uint8_t nameRowKey, uint8_t rowKey) const
+{
+    supportedType<T>();
+    queueNameRowType nameRows;
+    if (!db.Read(std::make_pair(nameRowKey, name), nameRows))
+        return;
+    for (auto& nameRow : nameRows) {
+        std::vector<queueEntryType<T>> rows;
+        if (db.Read(std::make_pair(rowKey, nameRow.nHeight), rows))
+            for (auto& row : view.hold(std::move(rows)))
+                if (row.first == name)
+                    view.add(row.second);
+    }
+}
+
+CClaimsForNameView CClaimTrieSnapshot::viewClaimsForName(const std::string& name) const
+{
+    const auto normalized = nNextHeight > Params().GetConsensus().nNormalizedNameForkHeight
+        ? CClaimTrieCacheNormalizationFork::normalizeName(name) : name;
+    CClaimsForNameView view(normalized, nNextHeight);
+
+    supportEntryType supports;
+    if (db.Read(std::make_pair(SUPPORT, normalized), supports))
+        for (auto& support : view.hold(std::move(supports)))
+            view.add(support);
+    addRowsFromQueue<CSupportValue>(view, normalized, SUPPORT_QUEUE_NAME_ROW, SUPPORT_QUEUE_ROW);
+
+    CClaimTrieData data;
+    if (db.Read(std::make_pair(TRIE_NODE, normalized), data)) {
+        view.nLastTakeoverHeight = data.nHeightOfLastTakeover;
+        for (auto& claim : view.hold(std::move(data.claims)))
+            view.add(claim);
+    }
+    addRowsFromQueue<CClaimValue>(view, normalized, CLAIM_QUEUE_NAME_ROW, CLAIM_QUEUE_ROW);
+
+    return view;
+}
+
+// claim trie snapshot file: magic, version, height, block hash, claim trie hash, then the database
+// entries as (length, key, length, value) with little endian lengths, followed by a SHA256 of all of it
+static const unsigned char CLAIMTRIE_SNAPSHOT_MAGIC[8] = {'l', 'b', 'r', 'y', 't', 'r', 'i', 'e'};
+static const uint32_t CLAIMTRIE_SNAPSHOT_VERSION = 1;
+static const std::size_t CLAIMTRIE_SNAPSHOT_HEADER_SIZE = sizeof(CLAIMTRIE_SNAPSHOT_MAGIC) + 4 + 4 + 32 + 32;
+static const std::size_t CLAIMTRIE_SNAPSHOT_BATCH_SIZE = 16 << 20;
+
+// entries that only make sense for the database they were written to
+static bool isSnapshotEntry(uint8_t prefix)
+{
+    return prefix != TRIE_HISTORY && prefix != TRIE_HISTORY_ROW && prefix != TRIE_HISTORY_START
+        && prefix != TRIE_CLEAN_SHUTDOWN && prefix != TRIE_NODE_CHILDREN && prefix != TRIE_SNAPSHOT_LOAD;
+}
+
+// the height, block hash and claim trie hash from the header of a snapshot, begin has to have the header's size
+static bool readSnapshotHeader(const fs::path& path, const unsigned char* begin, int& nHeight, uint256& hashBlock, uint256& hashClaimTrie)
+{
+    if (!std::equal(CLAIMTRIE_SNAPSHOT_MAGIC, CLAIMTRIE_SNAPSHOT_MAGIC + sizeof(CLAIMTRIE_SNAPSHOT_MAGIC), begin))
+        return error("%s(): %s isn't a claim trie snapshot", __func__, path.string());
+
+    auto pos = begin + sizeof(CLAIMTRIE_SNAPSHOT_MAGIC);
+    if (ReadLE32(pos) != CLAIMTRIE_SNAPSHOT_VERSION)
+        return error("%s(): unsupported claim trie snapshot version %u", __func__, ReadLE32(pos));
+
+    nHeight = ReadLE32(pos + 4);
+    std::copy(pos + 8, pos + 40, hashBlock.begin());
+    std::copy(pos + 40, pos + 72, hashClaimTrie.begin());
+    return true;
+}
+
+bool CClaimTrieSnapshot::writeToFile(const fs::path& path, const CBlockIndex* tip, std::size_t& nEntries) const
+{
+    if (!tip || tip->nHeight + 1 != nNextHeight)
+        return error("%s(): the snapshot isn't the one of block %s", __func__, tip ? tip->GetBlockHash().GetHex() : "(none)");
+
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s(): unable to open %s", __func__, path.string());
+
+    CSHA256 hasher;
+    auto write = [&file, &hasher](const unsigned char* data, std::size_t size) {
+        file.write((const char*)data, size);
+        hasher.Write(data, size);
+    };
+    auto writeLE32 = [&write](uint32_t value) {
+        unsigned char buf[4];
+        WriteLE32(buf, value);
+        write(buf, sizeof(buf));
+    };
+
+    nEntries = 0;
+    try {
+        write(CLAIMTRIE_SNAPSHOT_MAGIC, sizeof(CLAIMTRIE_SNAPSHOT_MAGIC));
+        writeLE32(CLAIMTRIE_SNAPSHOT_VERSION);
+        writeLE32(tip->nHeight);
+        const auto hashBlock = tip->GetBlockHash();
+        write(hashBlock.begin(), hashBlock.size());
+        write(tip->hashClaimTrie.begin(), tip->hashClaimTrie.size());
+
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            auto key = pcursor->GetKeyStream();
+            if (key.empty() || !isSnapshotEntry(key[0]))
+                continue;
+            auto value = pcursor->GetValueStream();
+            writeLE32(key.size());
+            write((const unsigned char*)key.data(), key.size());
+            writeLE32(value.size());
+            write((const unsigned char*)value.data(), value.size());
+            ++nEntries;
+        }
+
+        unsigned char checksum[CSHA256::OUTPUT_SIZE];
+        hasher.Finalize(checksum);
+        file.write((const char*)checksum, sizeof(checksum));
+    } catch (const std::exception& e) {
+        return error("%s(): unable to write %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
+std::shared_ptr<const CClaimTrieSnapshot> CClaimTrie::getSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
+void CClaimTrie::publishSnapshot()
+{
+    std::atomic_store(&snapshot, std::shared_ptr<const CClaimTrieSnapshot>(std::make_shared<CClaimTrieSnapshot>(*db, nNextHeight)));
+}
+
 void completeHash(uint256& partialHash, const std::string& key, std::size_t to)
 {
     CHash256 hasher;
@@ -411,6 +973,108 @@ void completeHash(uint256& partialHash, const std::string& key, std::size_t to)
             .Finalize(partialHash.begin());
 }
 
+int nClaimTrieHashThreads = 0;
+std::size_t nClaimTrieWriteBuffer = 0;
+
+struct CClaimTrieHashCheck
+{
+    std::function<bool()> job;
+
+    bool operator()()
+    {
+        return job();
+    }
+
+    void swap(CClaimTrieHashCheck& check)
+    {
+        job.swap(check.job);
+    }
+};
+
+// subtrees differ a lot in size so hand them out one by one
+static CCheckQueue<CClaimTrieHashCheck> hashcheckqueue(1);
+
+void ThreadClaimTrieHash()
+{
+    RenameThread("lbrycrd-triehash");
+    hashcheckqueue.Thread();
+}
+
+template <typename TIterator>
+std::size_t processSubtreesInParallel(const TIterator& it, bool dirtyOnly, const std::function<bool(TIterator&)>& process, bool& ok)
+{
+    ok = true;
+    if (!nClaimTrieHashThreads)
+        return 0;
+
+    // a few subtrees per thread evens out the load
+    const auto target = std::size_t(nClaimTrieHashThreads) * 8;
+    std::vector<TIterator> subtrees{it};
+    std::size_t depth = 0;
+    while (subtrees.size() < target) {
+        std::vector<TIterator> next;
+        for (auto& subtree : subtrees)
+            for (auto& child : subtree.children())
+                if (!dirtyOnly || child->hash.IsNull())
+                    next.push_back(std::move(child));
+        if (next.empty())
+            break;
+        subtrees.swap(next);
+        ++depth;
+    }
+    if (!depth)
+        return 0;
+
+    std::vector<CClaimTrieHashCheck> checks(subtrees.size());
+    for (std::size_t i = 0; i < subtrees.size(); ++i) {
+        auto& subtree = subtrees[i];
+        checks[i].job = [&process, &subtree]() { return process(subtree); };
+    }
+
+    CCheckQueueControl<CClaimTrieHashCheck> control(&hashcheckqueue);
+    control.Add(checks);
+    ok = control.Wait();
+    return depth;
+}
+
+template std::size_t processSubtreesInParallel(const CClaimTrie::iterator&, bool, const std::function<bool(CClaimTrie::iterator&)>&, bool&);
+template std::size_t processSubtreesInParallel(const CClaimTrie::const_iterator&, bool, const std::function<bool(CClaimTrie::const_iterator&)>&, bool&);
+
+CClaimTriePrefetch::CClaimTriePrefetch(const CDBWrapper& db, std::vector<std::string> names)
+    : names(std::move(names)), control(new CCheckQueueControl<CClaimTrieHashCheck>(nClaimTrieHashThreads ? &hashcheckqueue : nullptr))
+{
+    if (!nClaimTrieHashThreads || this->names.empty())
+        return;
+
+    // a few reads per job, the rows are found by point lookups in no particular order
+    const auto chunk = std::max<std::size_t>(1, this->names.size() / (std::size_t(nClaimTrieHashThreads) * 4));
+    std::vector<CClaimTrieHashCheck> checks;
+    for (auto it = this->names.begin(); it != this->names.end();) {
+        auto end = it + std::min<std::size_t>(chunk, std::distance(it, this->names.end()));
+        checks.emplace_back();
+        checks.back().job = [&db, it, end]() {
+            for (auto name = it; name != end; ++name) {
+                db.Prefetch(std::make_pair(SUPPORT, *name));
+                db.Prefetch(std::make_pair(CLAIM_QUEUE_NAME_ROW, *name));
+                db.Prefetch(std::make_pair(SUPPORT_QUEUE_NAME_ROW, *name));
+            }
+            return true;
+        };
+        it = end;
+    }
+    control->Add(checks);
+}
+
+CClaimTriePrefetch::~CClaimTriePrefetch()
+{
+    Wait();
+}
+
+void CClaimTriePrefetch::Wait()
+{
+    control.reset();
+}
+
 template <typename T>
 using iCbType = std::function<void(T&)>;
 
@@ -443,15 +1107,47 @@ bool CClaimTrieCacheBase::recursiveCheckConsistency(CClaimTrie::const_iterator&
 {
     struct CRecursiveBreak {};
     using iterator = CClaimTrie::const_iterator;
-    iCbType<iterator> process = [&failed, &process](iterator& it) {
-        if (it->hash.IsNull() || it->hash != recursiveMerkleHash(it, process)) {
+
+    // verify the deeper subtrees in parallel first, remembering the first node that fails
+    std::mutex failedMutex;
+    bool ok;
+    auto depth = processSubtreesInParallel<iterator>(it, false, [&](iterator& it) {
+        std::string subtreeFailed;
+        iCbType<iterator> check = [&subtreeFailed, &check](iterator& it) {
+            if (it->hash.IsNull() || it->hash != recursiveMerkleHash(it, check)) {
+                subtreeFailed = it.key();
+                throw CRecursiveBreak();
+            }
+        };
+        try {
+            check(it);
+        } catch (const CRecursiveBreak&) {
+            std::lock_guard<std::mutex> lock(failedMutex);
+            if (failed.empty())
+                failed = subtreeFailed;
+            return false;
+        }
+        return true;
+    }, ok);
+    if (!ok)
+        return false;
+
+    // then the nodes above them, the verified subtrees are not hashed again
+    std::size_t level = 0;
+    iCbType<iterator> top = [&](iterator& it) {
+        if (depth && level == depth)
+            return;
+        ++level;
+        auto hash = recursiveMerkleHash(it, top);
+        --level;
+        if (it->hash.IsNull() || it->hash != hash) {
             failed = it.key();
             throw CRecursiveBreak();
         }
     };
 
     try {
-        process(it);
+        top(it);
     } catch (const CRecursiveBreak&) {
         return false;
     }
@@ -486,6 +1182,76 @@ bool CClaimTrieCacheBase::checkConsistency() const
     return consistent;
 }
 
+bool CClaimTrie::checkInParts(CCriticalSection& cs, std::size_t nSubtrees, const std::function<bool()>& fnInterrupted, bool& fFinished)
+{
+    fFinished = false;
+    std::vector<std::string> top, subtrees;
+    {
+        LOCK(cs);
+        CClaimTrieCache(this).splitForConsistencyCheck(nSubtrees, top, subtrees);
+    }
+
+    // the nodes a block rewrites in between are rehashed by it
+    for (const auto& name : subtrees) {
+        if (fnInterrupted())
+            return true;
+        LOCK(cs);
+        if (!CClaimTrieCache(this).checkConsistency(name, true))
+            return false;
+    }
+    if (fnInterrupted())
+        return true;
+
+    LOCK(cs);
+    CClaimTrieCache trieCache(this);
+    for (auto it = top.rbegin(); it != top.rend(); ++it)
+        if (!trieCache.checkConsistency(*it, false))
+            return false;
+    fFinished = true;
+    fCheckPending = false;
+    return true;
+}
+
+bool CClaimTrieCacheBase::checkNodeHash(CClaimTrie::const_iterator& it) const
+{
+    using iterator = CClaimTrie::const_iterator;
+    iCbType<iterator> keep = [](iterator&) {}; // the children are taken as they are
+    return !it->hash.IsNull() && it->hash == recursiveMerkleHash(it, keep);
+}
+
+void CClaimTrieCacheBase::splitForConsistencyCheck(std::size_t nSubtrees, std::vector<std::string>& top, std::vector<std::string>& subtrees) const
+{
+    if (base->empty())
+        return;
+
+    std::vector<CClaimTrie::const_iterator> level{base->cbegin()};
+    while (!level.empty() && level.size() < nSubtrees) {
+        std::vector<CClaimTrie::const_iterator> next;
+        for (auto& it : level) {
+            top.push_back(it.key());
+            for (auto& child : it.children())
+                next.push_back(std::move(child));
+        }
+        level.swap(next);
+    }
+    for (auto& it : level)
+        subtrees.push_back(it.key());
+}
+
+bool CClaimTrieCacheBase::checkConsistency(const std::string& name, bool fSubtree) const
+{
+    const CClaimTrie& trie = *base;
+    auto it = trie.find(name);
+    if (!it)
+        return true;
+
+    std::string failed = name;
+    auto consistent = fSubtree ? recursiveCheckConsistency(it, failed) : checkNodeHash(it);
+    if (!consistent)
+        LogPrintf("%s: the hash of node %s doesn't match\n", __func__, failed);
+    return consistent;
+}
+
 template <typename K, typename T>
 void BatchWrite(CDBBatch& batch, uint8_t dbkey, const K& key, const std::vector<T>& value)
 {
@@ -496,11 +1262,43 @@ void BatchWrite(CDBBatch& batch, uint8_t dbkey, const K& key, const std::vector<
     }
 }
 
+// the values the entries written by a block had before it, kept with -claimtriehistory
+struct CHistoryChanges
+{
+    const CClaimTrie& trie;
+    std::map<std::vector<unsigned char>, std::vector<unsigned char>> before;
+
+    void record(std::vector<unsigned char>&& key, std::vector<unsigned char>&& value)
+    {
+        before.emplace(std::move(key), std::move(value)); // the first change is the one before the block
+    }
+
+    template <typename K, typename T>
+    void record(const K& key, const std::vector<T>& value)
+    {
+        std::vector<T> old;
+        auto vchOld = trie.read(key, old) ? serializeToVch(old) : std::vector<unsigned char>{};
+        auto vchNew = value.empty() ? std::vector<unsigned char>{} : serializeToVch(value);
+        if (vchOld != vchNew)
+            record(serializeToVch(key), std::move(vchOld));
+    }
+};
+
+// the effective amounts aren't serialized, nor compared by CClaimTrieData::operator==
+static bool equalEffectiveAmounts(const CClaimTrieData& a, const CClaimTrieData& b)
+{
+    return a.claims.size() == b.claims.size() && std::equal(a.claims.begin(), a.claims.end(), b.claims.begin(),
+        [](const CClaimValue& x, const CClaimValue& y) { return x.nEffectiveAmount == y.nEffectiveAmount; });
+}
+
 template <typename Container>
-void BatchWriteQueue(CDBBatch& batch, uint8_t dbkey, const Container& queue)
+void BatchWriteQueue(CDBBatch& batch, uint8_t dbkey, const Container& queue, CHistoryChanges* changes = nullptr)
 {
-    for (auto& itQueue : queue)
+    for (auto& itQueue : queue) {
+        if (changes)
+            changes->record(std::make_pair(dbkey, itQueue.first), itQueue.second);
         BatchWrite(batch, dbkey, itQueue.first, itQueue.second);
+    }
 }
 
 bool CClaimTrieCacheBase::flush()
@@ -513,116 +1311,489 @@ bool CClaimTrieCacheBase::flush()
                 return e.claim.claimId == claim.claimId;
             }
         );
-        if (it == claimsToAddToByIdIndex.end())
+        if (it == claimsToAddToByIdIndex.end()) {
             batch.Erase(std::make_pair(CLAIM_BY_ID, claim.claimId));
+            batch.Erase(std::make_pair(CLAIM_BY_HEX_ID, hexOrderedClaimId(claim.claimId)));
+        }
     }
 
-    for (const auto& e : claimsToAddToByIdIndex)
+    for (const auto& e : claimsToAddToByIdIndex) {
         batch.Write(std::make_pair(CLAIM_BY_ID, e.claim.claimId), e);
+        batch.Write(std::make_pair(CLAIM_BY_HEX_ID, hexOrderedClaimId(e.claim.claimId)), e.claim.claimId);
+    }
+
+    for (const auto& key : supportsToDeleteFromByIdIndex)
+        batch.Erase(std::make_pair(SUPPORT_BY_CLAIM_ID, key));
+
+    for (const auto& e : supportsToAddToByIdIndex)
+        batch.Write(std::make_pair(SUPPORT_BY_CLAIM_ID, e.first), e.second);
 
     getMerkleHash();
 
+    // only what is needed to look names up is kept in the history
+    CHistoryChanges history{*base, {}};
+    auto changes = base->nHistoryDepth && nNextHeight > base->nNextHeight ? &history : nullptr;
+
     for (const auto& nodeName : nodesToDelete) {
         if (nodesToAddOrUpdate.contains(nodeName))
             continue;
         auto nodes = base->nodes(nodeName);
+        std::vector<std::vector<unsigned char>> before;
+        if (changes)
+            for (auto& node : nodes)
+                before.push_back(serializeToVch(node.data()));
         base->erase(nodeName);
-        for (auto& node : nodes)
-            if (!node)
-                batch.Erase(std::make_pair(TRIE_NODE, node.key()));
+        base->rankName(nodeName, nullptr);
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i])
+                continue;
+            auto key = std::make_pair(TRIE_NODE, nodes[i].key());
+            batch.Erase(key);
+            if (changes)
+                changes->record(serializeToVch(key), std::move(before[i]));
+        }
     }
 
     for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
         auto old = base->find(it.key());
         if (!old || old.data() != it.data()) {
+            auto key = std::make_pair(TRIE_NODE, it.key());
+            if (changes)
+                changes->record(serializeToVch(key), old ? serializeToVch(old.data()) : std::vector<unsigned char>{});
             base->copy(it);
-            batch.Write(std::make_pair(TRIE_NODE, it.key()), it.data());
+            base->rankName(it.key(), &it.data());
+            batch.Write(key, it.data());
+        } else if (!equalEffectiveAmounts(old.data(), it.data())) {
+            // a change of support alone leaves the node as it is on disk
+            base->copy(it);
+            base->rankName(it.key(), &it.data());
         }
     }
 
-    BatchWriteQueue(batch, SUPPORT, supportCache);
+    BatchWriteQueue(batch, SUPPORT, supportCache, changes);
 
-    BatchWriteQueue(batch, CLAIM_QUEUE_ROW, claimQueueCache);
-    BatchWriteQueue(batch, CLAIM_QUEUE_NAME_ROW, claimQueueNameCache);
+    BatchWriteQueue(batch, CLAIM_QUEUE_ROW, claimQueueCache, changes);
+    BatchWriteQueue(batch, CLAIM_QUEUE_NAME_ROW, claimQueueNameCache, changes);
     BatchWriteQueue(batch, CLAIM_EXP_QUEUE_ROW, expirationQueueCache);
 
-    BatchWriteQueue(batch, SUPPORT_QUEUE_ROW, supportQueueCache);
-    BatchWriteQueue(batch, SUPPORT_QUEUE_NAME_ROW, supportQueueNameCache);
+    BatchWriteQueue(batch, SUPPORT_QUEUE_ROW, supportQueueCache, changes);
+    BatchWriteQueue(batch, SUPPORT_QUEUE_NAME_ROW, supportQueueNameCache, changes);
     BatchWriteQueue(batch, SUPPORT_EXP_QUEUE_ROW, supportExpirationQueueCache);
 
+    if (changes)
+        writeHistory(batch, history.before);
+    else if (base->nHistoryDepth && nNextHeight < base->nNextHeight)
+        eraseHistory(batch);
+
     base->nNextHeight = nNextHeight;
     if (!nodesToAddOrUpdate.empty() && (LogAcceptCategory(BCLog::CLAIMS) || LogAcceptCategory(BCLog::BENCH))) {
         LogPrintf("TrieCache size: %zu nodes on block %d, batch writes %zu bytes.\n",
                 nodesToAddOrUpdate.height(), nNextHeight, batch.SizeEstimate());
     }
-    auto ret = base->db->WriteBatch(batch);
+    auto ret = base->write(batch);
 
     clear();
     return ret;
 }
 
-bool CClaimTrieCacheBase::ReadFromDisk(const CBlockIndex* tip)
+void CClaimTrieCacheBase::writeHistory(CDBBatch& batch, const std::map<std::vector<unsigned char>, std::vector<unsigned char>>& before)
+{
+    const auto nHeight = nNextHeight - 1;
+    if (base->nHistoryStart < 0 || nHeight > base->nNextHeight) {
+        // the history starts with the state before the first recorded block; blocks
+        // flushed together can't be told apart so anything before them is unknown too
+        base->nHistoryStart = nHeight > base->nNextHeight ? nHeight : nHeight - 1;
+        if (base->nHistoryStart >= 0)
+            batch.Write(std::make_pair(TRIE_HISTORY_START, std::string()), base->nHistoryStart);
+    }
+
+    std::vector<std::vector<unsigned char>> keys;
+    keys.reserve(before.size());
+    for (auto& entry : before) {
+        batch.Write(std::make_pair(TRIE_HISTORY, std::make_pair(entry.first, heightToVch(nHeight))), entry.second);
+        keys.push_back(entry.first);
+    }
+    if (!keys.empty())
+        batch.Write(std::make_pair(TRIE_HISTORY_ROW, heightToVch(nHeight)), keys);
+
+    // the blocks that fell out of the depth go, the oldest one that can be looked up moves along
+    const auto nPruneHeight = nHeight - base->nHistoryDepth;
+    if (nPruneHeight >= 0) {
+        base->pruneHistory(batch, nPruneHeight);
+        if (nPruneHeight > base->nHistoryStart) {
+            base->nHistoryStart = nPruneHeight;
+            batch.Write(std::make_pair(TRIE_HISTORY_START, std::string()), base->nHistoryStart);
+        }
+    }
+}
+
+void CClaimTrieCacheBase::eraseHistory(CDBBatch& batch)
+{
+    // disconnected blocks take their history with them
+    for (auto nHeight = nNextHeight; nHeight < base->nNextHeight; ++nHeight) {
+        std::vector<std::vector<unsigned char>> keys;
+        if (!base->db->Read(std::make_pair(TRIE_HISTORY_ROW, heightToVch(nHeight)), keys))
+            continue;
+        for (auto& key : keys)
+            batch.Erase(std::make_pair(TRIE_HISTORY, std::make_pair(key, heightToVch(nHeight))));
+        batch.Erase(std::make_pair(TRIE_HISTORY_ROW, heightToVch(nHeight)));
+    }
+    // the state we are back to is the start of everything recorded from now on
+    if (base->nHistoryStart >= nNextHeight) {
+        base->nHistoryStart = nNextHeight - 1;
+        batch.Write(std::make_pair(TRIE_HISTORY_START, std::string()), base->nHistoryStart);
+    }
+}
+
+bool CClaimTrieCacheBase::loadHistory(const CBlockIndex* pindex)
+{
+    assert(pindex);
+    const auto nHeight = pindex->nHeight;
+    if (!base->nHistoryDepth || base->nHistoryStart < 0 || nHeight < base->nHistoryStart || nHeight >= nNextHeight
+        || nHeight < nNextHeight - 1 - base->nHistoryDepth)
+        return false;
+
+    // every trie node changed since that block is set to how it was then, everything else is unchanged;
+    // that is at most nHistoryDepth rows
+    std::set<std::string> names;
+    std::unique_ptr<CDBIterator> pcursor(base->db->NewIterator());
+    for (pcursor->Seek(std::make_pair(TRIE_HISTORY_ROW, heightToVch(nHeight + 1))); pcursor->Valid(); pcursor->Next()) {
+        std::pair<uint8_t, std::vector<unsigned char>> key;
+        if (!pcursor->GetKey(key) || key.first != TRIE_HISTORY_ROW)
+            break;
+        std::vector<std::vector<unsigned char>> keys;
+        if (!pcursor->GetValue(keys))
+            return error("%s(): error reading the claim trie history", __func__);
+        for (auto& vchKey : keys) {
+            if (vchKey.empty() || vchKey[0] != TRIE_NODE)
+                continue;
+            std::pair<uint8_t, std::string> nodeKey;
+            CDataStream(vchKey, SER_DISK, CLIENT_VERSION) >> nodeKey;
+            names.insert(std::move(nodeKey.second));
+        }
+    }
+
+    nHistoryHeight = nHeight;
+    nNextHeight = nHeight + 1;
+    for (auto& name : names) {
+        CClaimTrieData data;
+        base->read(std::make_pair(TRIE_NODE, name), data, nHistoryHeight);
+        auto it = cacheData(name, !data.empty());
+        if (!it || (data.empty() && it->empty()))
+            continue;
+        if (data.empty()) {
+            it->claims.clear();
+            for (auto& child : it.children())
+                cacheData(child.key(), false);
+            nodesToAddOrUpdate.erase(name);
+            nodesToDelete.insert(name);
+        } else {
+            it->claims = std::move(data.claims);
+            it->nHeightOfLastTakeover = data.nHeightOfLastTakeover;
+            it->reorderClaims(getSupportsForName(name));
+        }
+        markAsDirty(name, false);
+    }
+
+    if (getMerkleHash() != pindex->hashClaimTrie) {
+        LogPrintf("%s: the claim trie history doesn't match block %s\n", __func__, pindex->GetBlockHash().GetHex());
+        clear();
+        nHistoryHeight = -1;
+        nNextHeight = base->nNextHeight;
+        return false;
+    }
+    return true;
+}
+
+bool CClaimTrieCacheBase::ReadFromDisk(const CBlockIndex* tip, bool fCheckConsistency, bool fCheckLater)
 {
     LogPrintf("Loading the claim trie from disk...\n");
+    base->fCheckPending = !fCheckConsistency && fCheckLater;
 
     base->nNextHeight = nNextHeight = tip ? tip->nHeight + 1 : 0;
+    base->writePending();
 
     if (tip && base->db->Exists(std::make_pair(TRIE_NODE_CHILDREN, std::string()))) {
         LogPrintf("The claim trie database contains deprecated data and will need to be rebuilt.\n");
         return false;
     }
+    if (base->db->Exists(std::make_pair(TRIE_SNAPSHOT_LOAD, std::string())))
+        return error("%s(): loading a claim trie snapshot was cut short, start again with -loadclaimtrie or -reindex", __func__);
 
     clear();
     base->clear();
+    base->topClaims.clear();
+    base->controllingAmounts.clear();
     boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
 
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+    // all the supports in one sequential pass, the claims can't be ordered without them
+    const auto nTimeStart = GetTimeMicros();
+    std::unordered_map<std::string, supportEntryType> supports;
+    for (pcursor->Seek(std::make_pair(SUPPORT, std::string())); pcursor->Valid(); pcursor->Next()) {
         std::pair<uint8_t, std::string> key;
-        if (!pcursor->GetKey(key) || key.first != TRIE_NODE)
-            continue;
+        if (!pcursor->GetKey(key) || key.first != SUPPORT)
+            break;
+        if (!pcursor->GetValue(supports[key.second]))
+            return error("%s(): error reading claim trie supports from disk", __func__);
+    }
 
-        CClaimTrieData data;
-        if (pcursor->GetValue(data)) {
-            if (data.empty()) {
-                // we have a situation where our old trie had many empty nodes
-                // we don't want to automatically throw those all into our prefix trie
-                // we'll run a second pass to clean them up
-                continue;
+    // supports are looked up by claim id through SUPPORT_BY_CLAIM_ID, older databases and snapshots don't have it
+    pcursor->Seek(std::make_pair(SUPPORT_BY_CLAIM_ID, supportIndexKeyType()));
+    std::pair<uint8_t, supportIndexKeyType> indexKey;
+    if (!supports.empty() && (!pcursor->Valid() || !pcursor->GetKey(indexKey) || indexKey.first != SUPPORT_BY_CLAIM_ID)) {
+        LogPrintf("Indexing supports by claim id...\n");
+        CDBBatch batch(*base->db);
+        for (const auto& entry : supports)
+            for (const auto& support : entry.second)
+                batch.Write(std::make_pair(SUPPORT_BY_CLAIM_ID, supportIndexKeyType(support.supportedClaimId, support.outPoint)),
+                    CSupportIndexElement(entry.first, support));
+        base->db->WriteBatch(batch, true);
+    }
+    const auto nTimeSupports = GetTimeMicros();
+
+    // the nodes are copied out a chunk at a time and decoded by the hashing threads, the encoded and
+    // decoded copies of a chunk are alive together on top of the supports; the trie keeps the rest
+    static const std::size_t nChunkSize = 1 << 16;
+    std::vector<std::pair<std::string, CDataStream>> rawNodes;
+    std::vector<CClaimTrieData> nodes;
+    auto decode = [&rawNodes, &nodes, &supports](std::size_t begin, std::size_t end) {
+        static const supportEntryType noSupports;
+        for (auto i = begin; i < end; ++i) {
+            try {
+                rawNodes[i].second >> nodes[i];
+            } catch (const std::exception&) {
+                return false;
             }
-
             // nEffectiveAmount isn't serialized but it needs to be initialized (as done in reorderClaims):
-            auto supports = getSupportsForName(key.second);
-            data.reorderClaims(supports);
-            base->insert(key.second, std::move(data));
+            auto it = supports.find(rawNodes[i].first);
+            nodes[i].reorderClaims(it != supports.end() ? it->second : noSupports);
+        }
+        return true;
+    };
+
+    // we have a situation where our old trie had many empty nodes; we don't want to automatically
+    // throw those all into our prefix trie, they only keep the hash of branches created by the others
+    std::vector<std::pair<std::string, uint256>> emptyNodes;
+    std::size_t nNodes = 0;
+    int64_t nTimeRead = 0, nTimeDecode = 0, nTimeInsert = 0;
+    pcursor->Seek(std::make_pair(TRIE_NODE, std::string()));
+    for (bool fMore = true; fMore; ) {
+        auto nTime = GetTimeMicros();
+        rawNodes.clear();
+        for (; rawNodes.size() < nChunkSize; pcursor->Next()) {
+            std::pair<uint8_t, std::string> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != TRIE_NODE)
+                break;
+            rawNodes.emplace_back(std::move(key.second), pcursor->GetValueStream());
+        }
+        fMore = rawNodes.size() == nChunkSize;
+        nNodes += rawNodes.size();
+        nTimeRead += GetTimeMicros() - nTime;
+
+        nTime = GetTimeMicros();
+        nodes.clear();
+        nodes.resize(rawNodes.size());
+        bool decoded = true;
+        if (nClaimTrieHashThreads && !nodes.empty()) {
+            // a few chunks per thread evens out the load
+            const auto chunks = std::min(nodes.size(), std::size_t(nClaimTrieHashThreads) * 8);
+            std::vector<CClaimTrieHashCheck> checks(chunks);
+            for (std::size_t i = 0; i < chunks; ++i) {
+                auto begin = nodes.size() * i / chunks, end = nodes.size() * (i + 1) / chunks;
+                checks[i].job = [&decode, begin, end]() { return decode(begin, end); };
+            }
+            CCheckQueueControl<CClaimTrieHashCheck> control(&hashcheckqueue);
+            control.Add(checks);
+            decoded = control.Wait();
         } else {
+            decoded = decode(0, nodes.size());
+        }
+        if (!decoded)
             return error("%s(): error reading claim trie from disk", __func__);
+        nTimeDecode += GetTimeMicros() - nTime;
+
+        nTime = GetTimeMicros();
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].empty()) {
+                emptyNodes.emplace_back(std::move(rawNodes[i].first), nodes[i].hash);
+            } else {
+                base->rankName(rawNodes[i].first, &nodes[i]);
+                base->insert(rawNodes[i].first, std::move(nodes[i]));
+            }
+        }
+        nTimeInsert += GetTimeMicros() - nTime;
+    }
+    rawNodes = {};
+    nodes = {};
+
+    const auto nTime = GetTimeMicros();
+    for (auto& node : emptyNodes) {
+        if (auto hit = base->find(node.first))
+            hit->hash = node.second;
+        else
+            base->db->Erase(std::make_pair(TRIE_NODE, node.first)); // this uses a lot of memory and it's 1-time upgrade from 12.4 so we aren't going to batch it
+    }
+    nTimeInsert += GetTimeMicros() - nTime;
+
+    LogPrintf("Claim trie read from disk: %zu supports in %.2fms, %zu nodes in %.2fms, decoded in %.2fms, inserted in %.2fms\n",
+        supports.size(), 0.001 * (nTimeSupports - nTimeStart), nNodes, 0.001 * nTimeRead,
+        0.001 * nTimeDecode, 0.001 * nTimeInsert);
+
+    if (fCheckConsistency) {
+        const auto nTimeCheck = GetTimeMicros();
+        LogPrintf("Checking claim trie consistency... ");
+        if (!checkConsistency()) {
+            LogPrintf("inconsistent!\n");
+            return false;
         }
+        LogPrintf("consistent (%.2fms)\n", 0.001 * (GetTimeMicros() - nTimeCheck));
     }
+    if (tip && tip->hashClaimTrie != getMerkleHash())
+        return error("%s(): hashes don't match when reading claimtrie from disk", __func__);
+    base->publishSnapshot();
+    return true;
+}
 
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
-        std::pair<uint8_t, std::string> key;
-        if (!pcursor->GetKey(key) || key.first != TRIE_NODE)
-            continue;
-        auto hit = base->find(key.second);
-        if (hit) {
-            CClaimTrieData data;
-            if (pcursor->GetValue(data))
-                hit->hash = data.hash;
+bool CClaimTrieCacheBase::writeCleanShutdown()
+{
+    // node hashes nobody has checked yet mustn't be vouched for, the next start would trust them again
+    if (base->fCheckPending)
+        return false;
+    const auto record = std::make_pair(base->nNextHeight - 1, getMerkleHash());
+    if (!base->writePending())
+        return false;
+    return base->db->Write(std::make_pair(TRIE_CLEAN_SHUTDOWN, std::string()), record, true);
+}
+
+bool CClaimTrieCacheBase::readCleanShutdown(const CBlockIndex* tip)
+{
+    const auto key = std::make_pair(TRIE_CLEAN_SHUTDOWN, std::string());
+    std::pair<int, uint256> record;
+    if (!base->db->Read(key, record))
+        return false;
+    base->db->Erase(key, true);
+    return tip && record.first == tip->nHeight && record.second == tip->hashClaimTrie;
+}
+
+bool CClaimTrieCacheBase::loadSnapshot(const fs::path& path, const CBlockIndex* tip)
+{
+    LogPrintf("Loading the claim trie snapshot %s...\n", path.string());
+    if (!tip)
+        return error("%s(): there is no chain to load the snapshot for", __func__);
+
+    try {
+        // mapped rather than read, the entries are handed to the database right from the file
+        boost::interprocess::file_mapping mapping(path.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+        const auto begin = static_cast<const unsigned char*>(region.get_address());
+        const auto size = region.get_size();
+
+        if (size < CLAIMTRIE_SNAPSHOT_HEADER_SIZE + CSHA256::OUTPUT_SIZE)
+            return error("%s(): %s isn't a claim trie snapshot", __func__, path.string());
+
+        int nHeight;
+        uint256 hashBlock, hashClaimTrie;
+        if (!readSnapshotHeader(path, begin, nHeight, hashBlock, hashClaimTrie))
+            return false;
+
+        auto pos = begin + CLAIMTRIE_SNAPSHOT_HEADER_SIZE;
+        const auto end = begin + size - CSHA256::OUTPUT_SIZE;
+        unsigned char checksum[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(begin, end - begin).Finalize(checksum);
+        if (!std::equal(checksum, checksum + sizeof(checksum), end))
+            return error("%s(): %s is corrupt", __func__, path.string());
+
+        if (nHeight != tip->nHeight || hashBlock != tip->GetBlockHash() || hashClaimTrie != tip->hashClaimTrie)
+            return error("%s(): the snapshot was taken at block %s (%d), not at the tip %s (%d)", __func__,
+                hashBlock.GetHex(), nHeight, tip->GetBlockHash().GetHex(), tip->nHeight);
+
+        // the marker goes to disk first and only leaves with the last entry, the batches in between
+        // aren't synced and a crash among them leaves a database that is neither the old one nor the snapshot
+        const auto marker = std::make_pair(TRIE_SNAPSHOT_LOAD, std::string());
+        base->writePending();
+        if (!base->db->Write(marker, hashBlock, true))
+            return error("%s(): unable to mark the claim trie database as loading", __func__);
+
+        // everything else in the database goes, the history too: it won't connect to the snapshot
+        CDBBatch batch(*base->db);
+        std::unique_ptr<CDBIterator> pcursor(base->db->NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            std::pair<uint8_t, std::string> key;
+            if (pcursor->GetKey(key) && key.first == TRIE_SNAPSHOT_LOAD && key.second.empty())
+                continue;
+            batch.Erase(pcursor->GetKeyStream());
+            if (batch.SizeEstimate() > CLAIMTRIE_SNAPSHOT_BATCH_SIZE) {
+                base->db->WriteBatch(batch);
+                batch.Clear();
+            }
         }
-        else {
-            base->db->Erase(key); // this uses a lot of memory and it's 1-time upgrade from 12.4 so we aren't going to batch it
+        base->nHistoryStart = -1;
+
+        std::size_t nEntries = 0;
+        auto readEntry = [&pos, end](CDataStream& entry) {
+            if (end - pos < 4 || uint32_t(end - pos - 4) < ReadLE32(pos))
+                return false;
+            const auto length = ReadLE32(pos);
+            entry.write((const char*)pos + 4, length);
+            pos += 4 + length;
+            return true;
+        };
+        while (pos < end) {
+            CDataStream key(SER_DISK, CLIENT_VERSION), value(SER_DISK, CLIENT_VERSION);
+            if (!readEntry(key) || !readEntry(value))
+                return error("%s(): %s is truncated", __func__, path.string());
+            batch.Write(key, value);
+            if (batch.SizeEstimate() > CLAIMTRIE_SNAPSHOT_BATCH_SIZE) {
+                base->db->WriteBatch(batch);
+                batch.Clear();
+            }
+            ++nEntries;
         }
+        batch.Erase(marker);
+        if (!base->db->WriteBatch(batch, true))
+            return error("%s(): unable to write the claim trie snapshot", __func__);
+        LogPrintf("Loaded %zu claim trie entries from the snapshot of block %s (%d)\n", nEntries, hashBlock.GetHex(), nHeight);
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        return error("%s(): unable to map %s: %s", __func__, path.string(), e.what());
+    }
+
+    return ReadFromDisk(tip);
+}
+
+bool CClaimTrieCacheBase::needsSnapshot(const fs::path& path, const CBlockIndex* tip) const
+{
+    // a load that was cut short has to be finished
+    if (base->db->Exists(std::make_pair(TRIE_SNAPSHOT_LOAD, std::string())))
+        return true;
+
+    // what is wrong with a snapshot that can't be read is left to loadSnapshot to tell
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (!tip || file.IsNull())
+        return true;
+    unsigned char header[CLAIMTRIE_SNAPSHOT_HEADER_SIZE];
+    try {
+        file.read((char*)header, sizeof(header));
+    } catch (const std::ios_base::failure&) {
+        return true;
     }
+    int nHeight;
+    uint256 hashBlock, hashClaimTrie;
+    if (!readSnapshotHeader(path, header, nHeight, hashBlock, hashClaimTrie))
+        return true;
 
-    LogPrintf("Checking claim trie consistency... ");
-    if (checkConsistency()) {
-        LogPrintf("consistent\n");
-        if (tip && tip->hashClaimTrie != getMerkleHash())
-            return error("%s(): hashes don't match when reading claimtrie from disk", __func__);
+    auto block = tip->GetAncestor(nHeight);
+    if (!block || block->GetBlockHash() != hashBlock)
         return true;
+    if (block != tip) {
+        LogPrintf("The chain is past block %s (%d) of the claim trie snapshot, not loading it\n", hashBlock.GetHex(), nHeight);
+        return false;
     }
-    LogPrintf("inconsistent!\n");
-    return false;
+    CClaimTrieData root;
+    if (base->db->Read(std::make_pair(TRIE_NODE, std::string()), root) && root.hash == hashClaimTrie) {
+        LogPrintf("The claim trie is already at the snapshot of block %s (%d), not loading it again\n", hashBlock.GetHex(), nHeight);
+        return false;
+    }
+    return true;
 }
 
 CClaimTrieCacheBase::CClaimTrieCacheBase(CClaimTrie* base) : base(base)
@@ -644,6 +1815,14 @@ uint256 CClaimTrieCacheBase::recursiveComputeMerkleHash(CClaimTrie::iterator& it
             it->hash = recursiveMerkleHash(it, process);
         assert(!it->hash.IsNull());
     };
+    // dirty subtrees are independent, hash them in parallel and the remaining top of the trie after
+    bool ok;
+    processSubtreesInParallel<iterator>(it, true, [&process](iterator& it) {
+        process(it);
+        return true;
+    }, ok);
+    // no job fails, so a queue that says otherwise left subtrees unhashed
+    assert(ok);
     process(it);
     return it->hash;
 }
@@ -976,6 +2155,10 @@ bool CClaimTrieCacheBase::insertSupportIntoMap(const std::string& name, const CS
     sit->second.push_back(support);
     addTakeoverWorkaroundPotential(name);
 
+    supportIndexKeyType key(support.supportedClaimId, support.outPoint);
+    supportsToDeleteFromByIdIndex.erase(key);
+    supportsToAddToByIdIndex[key] = CSupportIndexElement(name, support);
+
     if (auto it = cacheData(name, false)) {
         markAsDirty(name, fCheckTakeover);
         it->reorderClaims(sit->second);
@@ -993,6 +2176,10 @@ bool CClaimTrieCacheBase::removeSupportFromMap(const std::string& name, const CO
     if (eraseOutPoint(sit->second, outPoint, &support)) {
         addTakeoverWorkaroundPotential(name);
 
+        supportIndexKeyType key(support.supportedClaimId, support.outPoint);
+        supportsToAddToByIdIndex.erase(key);
+        supportsToDeleteFromByIdIndex.insert(key);
+
         if (auto dit = cacheData(name, false)) {
             markAsDirty(name, fCheckTakeover);
             dit->reorderClaims(sit->second);
@@ -1368,6 +2555,8 @@ bool CClaimTrieCacheBase::clear()
     namesToCheckForTakeover.clear();
     supportExpirationQueueCache.clear();
     claimsToDeleteFromByIdIndex.clear();
+    supportsToAddToByIdIndex.clear();
+    supportsToDeleteFromByIdIndex.clear();
     return true;
 }
 
@@ -1418,21 +2607,31 @@ bool CClaimTrieCacheBase::getProofForName(const std::string& name, CClaimTriePro
 }
 
 void CClaimTrieCacheBase::iterate(std::function<void(const std::string&, const CClaimTrieData&)> callback) const
+{
+    iterateFrom({}, [&callback](const std::string& name, const CClaimTrieData& data) {
+        callback(name, data);
+        return true;
+    });
+}
+
+void CClaimTrieCacheBase::iterateFrom(const std::string& start, std::function<bool(const std::string&, const CClaimTrieData&)> callback) const
 {
     if (nodesToAddOrUpdate.empty()) {
-        for (auto it = base->cbegin(); it != base->cend(); ++it)
-            if (!nodesToDelete.count(it.key()))
-                callback(it.key(), it.data());
+        for (auto it = base->lower_bound(start); it != base->end(); ++it)
+            if (!nodesToDelete.count(it.key()) && !callback(it.key(), it.data()))
+                return;
         return;
     }
+    // the cache's nodes are interleaved with the base's, so walk them all and leave out what comes before start
     for (auto it = nodesToAddOrUpdate.begin(); it != nodesToAddOrUpdate.end(); ++it) {
-        callback(it.key(), it.data());
+        if (it.key() >= start && !callback(it.key(), it.data()))
+            return;
         if (it.hasChildren() || nodesToDelete.count(it.key()))
             continue;
         auto children = base->find(it.key()).children();
         for (auto& child : children)
             for (; child; ++child)
-                if (!nodesToDelete.count(child.key()))
-                    callback(child.key(), child.data());
+                if (!nodesToDelete.count(child.key()) && child.key() >= start && !callback(child.key(), child.data()))
+                    return;
     }
 }
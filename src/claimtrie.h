@@ -8,10 +8,15 @@
 #include <prefixtrie.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <sync.h>
 #include <uint256.h>
 #include <util.h>
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -28,6 +33,34 @@
 #define SUPPORT_QUEUE_ROW 'u'
 #define SUPPORT_QUEUE_NAME_ROW 'p'
 #define SUPPORT_EXP_QUEUE_ROW 'x'
+#define TRIE_HISTORY 'v'
+#define TRIE_HISTORY_ROW 'w'
+#define TRIE_HISTORY_START 'y'
+#define TRIE_CLEAN_SHUTDOWN 'c'
+#define CLAIM_BY_HEX_ID 'h'
+#define SUPPORT_BY_CLAIM_ID 'k'
+#define TRIE_SNAPSHOT_LOAD 'l'
+
+std::vector<unsigned char> heightToVch(int n);
+
+// the claim id with its bytes in the order they read in hex, so ids sharing a hex prefix sort next to each other
+uint160 hexOrderedClaimId(const uint160& claimId);
+
+template <typename T>
+std::vector<unsigned char> serializeToVch(const T& value)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << value;
+    return {ss.begin(), ss.end()};
+}
+
+template <typename T>
+std::string serializeToString(const T& value)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << value;
+    return ss.str();
+}
 
 uint256 getValueHash(const COutPoint& outPoint, int nHeightOfLastTakeover);
 
@@ -86,6 +119,13 @@ struct CClaimValue
     {
         return !(*this == other);
     }
+
+    // the outpoint is fixed, so the value hash only changes with the takeover height of the name
+    const uint256& getValueHash(int nHeightOfLastTakeover);
+
+private:
+    uint256 valueHash;
+    int nValueHashTakeover = -1;
 };
 
 struct CSupportValue
@@ -152,6 +192,14 @@ struct CClaimTrieData
     bool haveClaim(const COutPoint& outPoint) const;
     void reorderClaims(const supportEntryType& support);
 
+    // the value hashes of the claims in order and their merkle root, redone only where the claims
+    // or the takeover height changed since the last call; the const versions work them out anew
+    // and leave what is kept alone, so a node that is only read can be read on any thread
+    const std::vector<uint256>& getClaimHashes();
+    const uint256& getClaimsMerkleRoot();
+    std::vector<uint256> getClaimHashes() const;
+    uint256 getClaimsMerkleRoot() const;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -187,6 +235,10 @@ struct CClaimTrieData
     {
         return claims.empty();
     }
+
+private:
+    std::vector<uint256> claimHashes;
+    uint256 claimsMerkleRoot;
 };
 
 struct COutPointHeightType
@@ -284,6 +336,29 @@ struct CClaimIndexElement
     CClaimValue claim;
 };
 
+/** An active support and the name it is under, kept by supported claimId and outpoint in SUPPORT_BY_CLAIM_ID */
+struct CSupportIndexElement
+{
+    CSupportIndexElement() = default;
+
+    CSupportIndexElement(std::string name, CSupportValue support)
+        : name(std::move(name)), support(std::move(support))
+    {
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(name);
+        READWRITE(support);
+    }
+
+    std::string name;
+    CSupportValue support;
+};
+
 struct CClaimNsupports
 {
     CClaimNsupports() = default;
@@ -343,6 +418,157 @@ struct CClaimSupportToName
     const std::vector<CSupportValue> unmatchedSupports;
 };
 
+/** Something a block changed in the claims or supports of a name, see -zmqpubclaimtrie */
+struct CClaimTrieChange
+{
+    enum Type : uint8_t {
+        CLAIM_ADDED,
+        CLAIM_UPDATED,
+        CLAIM_REMOVED,
+        CLAIM_ACTIVATED,
+        SUPPORT_ADDED,
+        SUPPORT_REMOVED,
+        SUPPORT_ACTIVATED,
+        TAKEOVER,
+    };
+
+    uint8_t type = CLAIM_ADDED;
+    std::string name;
+    // the claim, the supported one or, with a takeover, the one that controls the name now (null if none does)
+    uint160 claimId;
+    // the claim or support output
+    COutPoint outPoint;
+    CAmount nAmount = 0;
+    // of the claim with all its supports once the block is connected
+    CAmount nEffectiveAmount = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(type);
+        READWRITE(name);
+        READWRITE(claimId);
+        READWRITE(outPoint);
+        READWRITE(nAmount);
+        READWRITE(nEffectiveAmount);
+    }
+};
+
+/** What a connected or disconnected block changed in the claim trie */
+struct CClaimTrieBlockChanges
+{
+    uint256 hashBlock;
+    int nHeight = 0;
+    // when the block is disconnected these are the changes it had made, which are now undone
+    bool fConnected = true;
+    std::vector<CClaimTrieChange> changes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(fConnected);
+        READWRITE(changes);
+    }
+};
+
+/** Add what the block at nHeight changed in the claims for a name, given them before and after the block was connected */
+void AppendClaimTrieChanges(std::vector<CClaimTrieChange>& changes, const CClaimSupportToName& before, const CClaimSupportToName& after, int nHeight);
+
+template <typename T>
+class COptional;
+
+/**
+ * The claims of a name in bid order and their supports, as CClaimSupportToName has them but without
+ * copying them into it: what the cache has in memory is referenced, only rows read from the database
+ * are held, and the supports and amounts of a claim are only looked up when asked for.
+ * It must not be used after the cache it was taken from is changed or gone.
+ */
+class CClaimsForNameView
+{
+public:
+    CClaimsForNameView(std::string name, int nNextHeight) : name(std::move(name)), nNextHeight(nNextHeight) {}
+
+    const std::string& getName() const { return name; }
+    int getLastTakeoverHeight() const { return nLastTakeoverHeight; }
+
+    std::size_t size() const { return claims.size(); }
+    bool empty() const { return claims.empty(); }
+    const CClaimValue& claim(std::size_t i) const { return *claims[i]; }
+
+    /** The index of the claim with claimId, or of the first one whose hex id starts with partialId; size() if there is none */
+    std::size_t find(const uint160& claimId) const;
+    std::size_t find(const std::string& partialId) const;
+
+    /** Call fn with every support of claim i */
+    template <typename F>
+    void forEachSupport(std::size_t i, F fn) const
+    {
+        // a claim id's supports all go to its first claim
+        if (find(claims[i]->claimId) != i)
+            return;
+        for (auto support : supports)
+            if (support->supportedClaimId == claims[i]->claimId)
+                fn(*support);
+    }
+
+    /** Call fn with every support of a claim id none of the claims has */
+    template <typename F>
+    void forEachUnmatchedSupport(F fn) const
+    {
+        for (auto support : supports)
+            if (find(support->supportedClaimId) == claims.size())
+                fn(*support);
+    }
+
+    /** Amount of claim i and its supports that counts in the bidding at the next block */
+    CAmount effectiveAmount(std::size_t i) const;
+    /** Amount of claim i and all its supports, whether they count in the bidding yet or not */
+    CAmount fullAmount(std::size_t i) const;
+    /** Claim indexes by height and output, the sequence getclaimbyseq counts in */
+    std::vector<std::size_t> seqOrder() const;
+
+private:
+    friend class CClaimTrieCacheBase;
+    friend class CClaimTrieSnapshot;
+
+    std::string name;
+    int nLastTakeoverHeight = 0;
+    int nNextHeight;
+    std::vector<const CClaimValue*> claims;
+    std::vector<const CSupportValue*> supports;
+    // what had to be read from the database, the claims and supports above can point into it
+    std::vector<std::shared_ptr<const void>> held;
+
+    void add(const CClaimValue& claim) { claims.push_back(&claim); }
+    void add(const CSupportValue& support) { supports.push_back(&support); }
+
+    template <typename T>
+    const T& hold(T&& value)
+    {
+        auto owned = std::make_shared<const T>(std::move(value));
+        held.push_back(owned);
+        return *owned;
+    }
+
+    template <typename T>
+    const T& hold(COptional<const T>&& row)
+    {
+        if (!row.unique())
+            return *row;
+        auto owned = std::make_shared<COptional<const T>>(std::move(row));
+        held.push_back(owned);
+        return **owned;
+    }
+};
+
+class CClaimTrieSnapshot;
+
 class CClaimTrie : public CPrefixTrie<std::string, CClaimTrieData>
 {
 public:
@@ -350,13 +576,30 @@ public:
     virtual ~CClaimTrie() = default;
     CClaimTrie(CClaimTrie&&) = delete;
     CClaimTrie(const CClaimTrie&) = delete;
-    CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor = 32, std::size_t cacheMB=200);
+    CClaimTrie(bool fMemory, bool fWipe, int proportionalDelayFactor = 32, std::size_t cacheMB=200, int nHistoryDepth = 0, bool fRanking = false);
 
     CClaimTrie& operator=(CClaimTrie&&) = delete;
     CClaimTrie& operator=(const CClaimTrie&) = delete;
 
     bool SyncToDisk();
 
+    /**
+     * Recheck the node hashes of a trie read without checking them, a subtree at a time with cs held
+     * for one subtree only so blocks keep connecting meanwhile; the nodes above the subtrees go last.
+     * fnInterrupted is asked before every subtree and stops the check unfinished when it returns true.
+     * Returns false on a mismatch. Until a check has finished no clean shutdown record is written.
+     */
+    bool checkInParts(CCriticalSection& cs, std::size_t nSubtrees, const std::function<bool()>& fnInterrupted, bool& fFinished);
+
+    /**
+     * Keep up to nBytes of the database writes of flushed blocks in memory and write them out
+     * together, 0 writes every block as it is flushed. Reads see the kept writes, the snapshot
+     * only once they are written out. Ignored with -claimtriehistory.
+     */
+    void setWriteBuffer(std::size_t nBytes);
+    /** Write out the database writes kept by the write buffer */
+    bool writePending();
+
     friend class CClaimTrieCacheBase;
     friend struct ClaimTrieChainFixture;
     friend class CClaimTrieCacheExpirationFork;
@@ -368,10 +611,195 @@ public:
     std::size_t getTotalClaimsInTrie() const;
     CAmount getTotalValueOfClaimsInTrie(bool fControllingOnly) const;
 
+    /**
+     * The active supports of a claim, whichever names they are under, read from SUPPORT_BY_CLAIM_ID
+     * rather than from the supports of every name. Supports waiting in the queue are not included.
+     */
+    std::vector<CSupportIndexElement> getSupportsForClaimId(const uint160& claimId);
+
+    /**
+     * The names whose controlling claims have the highest effective amounts, with those amounts,
+     * skipping the first nStart; ties are in name order. The ranking is kept as blocks are flushed,
+     * with -claimtrieranking only; without it there are none.
+     */
+    std::vector<std::pair<std::string, CAmount>> getTopClaims(std::size_t nStart, std::size_t nLimit) const;
+    bool hasRanking() const { return fRanking; }
+
+    /** Read a database entry as it was at the end of block nHeight, or as it is now if nHeight is negative */
+    template <typename K, typename V>
+    bool read(const K& key, V& value, int nHeight = -1) const
+    {
+        std::vector<unsigned char> vchValue;
+        if (nHeight >= 0 && findHistory(serializeToVch(key), nHeight, vchValue)) {
+            if (vchValue.empty())
+                return false;
+            CDataStream ssValue(vchValue, SER_DISK, CLIENT_VERSION);
+            ssValue >> value;
+            return true;
+        }
+        if (!pending.empty()) {
+            auto it = pending.find(serializeToString(key));
+            if (it != pending.end()) {
+                if (it->second.empty())
+                    return false;
+                try {
+                    CDataStream ssValue(it->second.data(), it->second.data() + it->second.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue.Xor(dbwrapper_private::GetObfuscateKey(*db));
+                    ssValue >> value;
+                } catch (const std::exception&) {
+                    return false;
+                }
+                return true;
+            }
+        }
+        return db->Read(key, value);
+    }
+
+    /** The trie as of the last flushed block; unlike the trie itself it can be used without cs_main */
+    std::shared_ptr<const CClaimTrieSnapshot> getSnapshot() const;
+
 protected:
     int nNextHeight = 0;
     int nProportionalDelayFactor = 0;
     std::unique_ptr<CDBWrapper> db;
+
+    // with -claimtriehistory every block records the entries it overwrites, keyed by the entry
+    // and the block height, so the trie can be looked up as it was at any height since nHistoryStart;
+    // the records of blocks more than nHistoryDepth below the tip are dropped as blocks are flushed.
+    // The expiration queues and the claim id index aren't recorded: no RPC reads them as of a block.
+    int nHistoryDepth = 0;
+    int nHistoryStart = -1;
+
+    bool findHistory(const std::vector<unsigned char>& key, int nHeight, std::vector<unsigned char>& value) const;
+    // erase the records of the blocks up to nHeight
+    void pruneHistory(CDBBatch& batch, int nHeight) const;
+
+    // replaced (atomically) whenever the database changes, readers keep the one they got alive
+    std::shared_ptr<const CClaimTrieSnapshot> snapshot;
+    void publishSnapshot();
+
+    // database writes of flushed blocks not written out yet, by serialized key; an empty value is an erase
+    std::size_t nWriteBuffer = 0;
+    std::size_t nPendingBytes = 0;
+    std::map<std::string, std::string> pending;
+    bool write(CDBBatch& batch);
+
+    // the node hashes were read trusting them and checkInParts hasn't gone through them yet
+    std::atomic<bool> fCheckPending{false};
+
+    // with -claimtrieranking the names ranked by the effective amount of their controlling claim.
+    // The ranking points at the keys of controllingAmounts, which don't move, so it holds one copy
+    // of each name on top of the trie's own. That is roughly 120 bytes a name, plus the name itself
+    // when it's too long for std::string to keep inline.
+    bool fRanking = false;
+    struct CTopClaimsOrder
+    {
+        bool operator()(const std::pair<CAmount, const std::string*>& a, const std::pair<CAmount, const std::string*>& b) const
+        {
+            return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+        }
+    };
+    std::unordered_map<std::string, CAmount> controllingAmounts;
+    std::set<std::pair<CAmount, const std::string*>, CTopClaimsOrder> topClaims;
+    /** Rank the name by the node it has now, a null or empty one takes it out of the ranking */
+    void rankName(const std::string& name, const CClaimTrieData* data);
+};
+
+/**
+ * Read-only view of the claim trie database as it was when a block was flushed.
+ * It is never modified, so any number of threads can query it while the chain moves on;
+ * it must not outlive the CClaimTrie it was taken from.
+ */
+class CClaimTrieSnapshot
+{
+public:
+    CClaimTrieSnapshot(const CDBWrapper& db, int nNextHeight);
+
+    CClaimTrieSnapshot(const CClaimTrieSnapshot&) = delete;
+    CClaimTrieSnapshot& operator=(const CClaimTrieSnapshot&) = delete;
+
+    /** Height of the next block, the one the snapshot's claims are valid for */
+    const int nNextHeight;
+
+    CClaimSupportToName getClaimsForName(const std::string& name) const;
+    CClaimsForNameView viewClaimsForName(const std::string& name) const;
+
+    /**
+     * Write the database entries the trie is rebuilt from to a claim trie snapshot file.
+     * tip has to be the block the snapshot was published for; see CClaimTrieCacheBase::loadSnapshot.
+     */
+    bool writeToFile(const fs::path& path, const CBlockIndex* tip, std::size_t& nEntries) const;
+
+private:
+    CDBSnapshot db;
+
+    template <typename T>
+    void insertRowsFromQueue(std::vector<T>& result, const std::string& name, uint8_t nameRowKey, uint8_t rowKey) const;
+
+    template <typename T>
+    void addRowsFromQueue(CClaimsForNameView& view, const std::string& name, uint8_t nameRowKey, uint8_t rowKey) const;
+};
+
+/** Maximum number of threads hashing the claim trie */
+static const int MAX_CLAIMTRIE_HASH_THREADS = 16;
+/** -claimtriehashthreads default (number of threads hashing the claim trie, 0 = auto) */
+static const int DEFAULT_CLAIMTRIE_HASH_THREADS = 0;
+
+/** -checkclaimtrie default (after a clean shutdown: 0 = compare the root hash only, 1 = recheck the node hashes in the background, 2 = recheck them before starting) */
+static const int DEFAULT_CHECKCLAIMTRIE = 1;
+
+/** -claimtriehistory default (blocks below the tip whose claim trie can be looked up without rolling back, 0 = none) */
+static const int DEFAULT_CLAIMTRIE_HISTORY = 0;
+
+/** -claimtrieranking default */
+static const bool DEFAULT_CLAIMTRIE_RANKING = false;
+
+/** -claimtriewritebuffer default (megabytes of claim trie database writes kept across blocks during the initial sync) */
+static const int64_t DEFAULT_CLAIMTRIE_WRITE_BUFFER = 64;
+
+/** Bytes of claim trie database writes kept across blocks during the initial sync, see CClaimTrie::setWriteBuffer */
+extern std::size_t nClaimTrieWriteBuffer;
+
+/** Number of threads hashing the claim trie, 0 means all hashing is done on the calling thread */
+extern int nClaimTrieHashThreads;
+
+/** Run an instance of the claim trie hashing thread */
+void ThreadClaimTrieHash();
+
+/**
+ * Hash the independent subtrees below it on the claim trie hashing threads.
+ * The subtrees are collected breadth first (only the ones with a null hash if dirtyOnly)
+ * until there is enough of them to keep the threads busy; process must only touch the subtree it is given.
+ * Returns the depth of the processed subtrees below it, 0 if nothing was done in parallel;
+ * ok is set to false if process failed on any of them.
+ */
+template <typename TIterator>
+std::size_t processSubtreesInParallel(const TIterator& it, bool dirtyOnly, const std::function<bool(TIterator&)>& process, bool& ok);
+
+struct CClaimTrieHashCheck;
+template <typename T>
+class CCheckQueueControl;
+
+/**
+ * Reads the database rows kept by name (supports and the claim and support queue rows) for the names
+ * a block is about to touch, on the claim trie hashing threads, so applying the block finds them in the
+ * database cache. The reads go on in the background until Wait(), which has to come before anything
+ * else uses the hashing threads. Nothing is read without hashing threads.
+ */
+class CClaimTriePrefetch
+{
+public:
+    CClaimTriePrefetch(const CDBWrapper& db, std::vector<std::string> names);
+    ~CClaimTriePrefetch();
+
+    CClaimTriePrefetch(const CClaimTriePrefetch&) = delete;
+    CClaimTriePrefetch& operator=(const CClaimTriePrefetch&) = delete;
+
+    void Wait();
+
+private:
+    const std::vector<std::string> names;
+    std::unique_ptr<CCheckQueueControl<CClaimTrieHashCheck>> control;
 };
 
 struct CClaimTrieProofNode
@@ -476,6 +904,8 @@ typedef std::map<int, expirationQueueRowType> expirationQueueType;
 typedef std::set<CClaimValue> claimIndexClaimListType;
 typedef std::vector<CClaimIndexElement> claimIndexElementListType;
 
+typedef std::pair<uint160, COutPoint> supportIndexKeyType;
+
 class CClaimTrieCacheBase
 {
 public:
@@ -487,7 +917,36 @@ public:
     bool flush();
     bool empty() const;
     bool checkConsistency() const;
-    bool ReadFromDisk(const CBlockIndex* tip);
+    /**
+     * Split the trie for checking it a part at a time: top gets the names of the nodes above the
+     * first level that has at least nSubtrees nodes, subtrees the names of the nodes on that level.
+     */
+    void splitForConsistencyCheck(std::size_t nSubtrees, std::vector<std::string>& top, std::vector<std::string>& subtrees) const;
+    /**
+     * Check the node hashes of the subtree at name, or with fSubtree false only the node's own hash
+     * against its claims and the hashes its children have. A name that is gone is consistent.
+     */
+    bool checkConsistency(const std::string& name, bool fSubtree) const;
+    // without fCheckConsistency only the root hash is compared to the tip's, the stored node hashes are trusted;
+    // with fCheckLater too they are only until CClaimTrie::checkInParts has been through them
+    bool ReadFromDisk(const CBlockIndex* tip, bool fCheckConsistency = true, bool fCheckLater = false);
+
+    // a clean shutdown records the height and root hash the trie was left at, unless a check of the
+    // node hashes is still pending; reading the record back removes it, it only vouches for the next load
+    bool writeCleanShutdown();
+    bool readCleanShutdown(const CBlockIndex* tip);
+
+    /**
+     * Replace the claim trie database with the entries of a snapshot file written at tip,
+     * then load the trie and check it against the tip's claim trie hash. A marker is kept in
+     * the database until the last entry is written, ReadFromDisk refuses a half loaded one.
+     */
+    bool loadSnapshot(const fs::path& path, const CBlockIndex* tip);
+    // whether -loadclaimtrie still has to load the snapshot: not once the database holds it or the chain went past its block
+    bool needsSnapshot(const fs::path& path, const CBlockIndex* tip) const;
+
+    // start reading what claims and supports under these names need from the database, see CClaimTriePrefetch
+    std::unique_ptr<CClaimTriePrefetch> prefetch(const std::vector<std::string>& names) const;
 
     bool haveClaim(const std::string& name, const COutPoint& outPoint) const;
     bool haveClaimInQueue(const std::string& name, const COutPoint& outPoint, int& nValidAtHeight) const;
@@ -526,11 +985,21 @@ public:
     virtual bool finalizeDecrement(std::vector<std::pair<std::string, int>>& takeoverHeightUndo);
 
     virtual CClaimSupportToName getClaimsForName(const std::string& name) const;
+    virtual CClaimsForNameView viewClaimsForName(const std::string& name) const;
 
     CClaimTrie::const_iterator find(const std::string& name) const;
     void iterate(std::function<void(const std::string&, const CClaimTrieData&)> callback) const;
+    /** Like iterate, from the first name that does not sort before start and until callback returns false */
+    void iterateFrom(const std::string& start, std::function<bool(const std::string&, const CClaimTrieData&)> callback) const;
 
     void dumpToLog(CClaimTrie::const_iterator it, bool diffFromBase = true) const;
+
+    /**
+     * Show the claim trie as it was at the end of block pindex, looked up from the recorded history.
+     * Returns false if the history doesn't reach that block or doesn't match its claim trie hash.
+     * Meant for a fresh cache that only serves lookups afterwards.
+     */
+    bool loadHistory(const CBlockIndex* pindex);
     virtual std::string adjustNameForValidHeight(const std::string& name, int validHeight) const;
 
 protected:
@@ -541,6 +1010,7 @@ protected:
 
     virtual uint256 recursiveComputeMerkleHash(CClaimTrie::iterator& it);
     virtual bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const;
+    virtual bool checkNodeHash(CClaimTrie::const_iterator& it) const;
 
     virtual bool insertClaimIntoTrie(const std::string& name, const CClaimValue& claim, bool fCheckTakeover);
     virtual bool removeClaimFromTrie(const std::string& name, const COutPoint& outPoint, CClaimValue& claim, bool fCheckTakeover);
@@ -570,6 +1040,7 @@ protected:
 
 private:
     uint256 hashBlock;
+    int nHistoryHeight = -1; // set by loadHistory, reads come from the history at that height
 
     std::unordered_map<std::string, std::pair<uint160, int>> takeoverCache;
 
@@ -579,6 +1050,8 @@ private:
     queueNameType supportQueueNameCache;
     claimIndexElementListType claimsToAddToByIdIndex; // written to index on flush
     claimIndexClaimListType claimsToDeleteFromByIdIndex;
+    std::map<supportIndexKeyType, CSupportIndexElement> supportsToAddToByIdIndex; // written to index on flush
+    std::set<supportIndexKeyType> supportsToDeleteFromByIdIndex;
 
     std::unordered_map<std::string, supportEntryType> supportCache;  // to be added/updated to base (and disk) on flush
     std::unordered_set<std::string> nodesToDelete; // to be removed from base (and disk) on flush
@@ -591,6 +1064,9 @@ private:
 
     bool clear();
 
+    void writeHistory(CDBBatch& batch, const std::map<std::vector<unsigned char>, std::vector<unsigned char>>& before);
+    void eraseHistory(CDBBatch& batch);
+
     void markAsDirty(const std::string& name, bool fCheckTakeover);
     bool removeSupport(const std::string& name, const COutPoint& outPoint, int nHeight, int& nValidAtHeight, bool fCheckTakeover);
     bool removeClaim(const std::string& name, const COutPoint& outPoint, int nHeight, int& nValidAtHeight, bool fCheckTakeover);
@@ -598,6 +1074,9 @@ private:
     template <typename T>
     void insertRowsFromQueue(std::vector<T>& result, const std::string& name) const;
 
+    template <typename T>
+    void addRowsFromQueue(CClaimsForNameView& view, const std::string& name) const;
+
     template <typename T>
     std::vector<queueEntryType<T>>* getQueueCacheRow(int nHeight, bool createIfNotExists);
 
@@ -694,6 +1173,10 @@ public:
     // lower-case and normalize any input string name
     // see: https://unicode.org/reports/tr15/#Norm_Forms
     std::string normalizeClaimName(const std::string& name, bool force = false) const; // public only for validating name field on update op
+    // normalize regardless of height, usable without a cache
+    static std::string normalizeName(const std::string& name);
+    // what normalizeName does to names that aren't plain ascii, through ICU and without remembering them
+    static std::string normalizeUnicode(const std::string& name);
 
     bool incrementBlock(insertUndoType& insertUndo,
         claimQueueRowType& expireUndo,
@@ -709,6 +1192,7 @@ public:
     bool getProofForName(const std::string& name, CClaimTrieProof& proof) override;
     bool getInfoForName(const std::string& name, CClaimValue& claim) const override;
     CClaimSupportToName getClaimsForName(const std::string& name) const override;
+    CClaimsForNameView viewClaimsForName(const std::string& name) const override;
     std::string adjustNameForValidHeight(const std::string& name, int validHeight) const override;
 
 protected:
@@ -746,6 +1230,7 @@ public:
 protected:
     uint256 recursiveComputeMerkleHash(CClaimTrie::iterator& it) override;
     bool recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const override;
+    bool checkNodeHash(CClaimTrie::const_iterator& it) const override;
 
 private:
     void copyAllBaseToCache();
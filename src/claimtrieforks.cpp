@@ -2,6 +2,7 @@
 #include <consensus/merkle.h>
 #include <chainparams.h>
 #include <claimtrie.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 
 #include <boost/locale.hpp>
@@ -10,6 +11,11 @@
 #include <boost/scope_exit.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 CClaimTrieCacheExpirationFork::CClaimTrieCacheExpirationFork(CClaimTrie* base)
     : CClaimTrieCacheBase(base)
 {
@@ -72,6 +78,7 @@ bool CClaimTrieCacheExpirationFork::forkForExpirationChange(bool increment)
     */
 
     //look through db for expiration queues, if we haven't already found it in dirty expiration queue
+    base->writePending();
     boost::scoped_ptr<CDBIterator> pcursor(base->db->NewIterator());
     for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
         std::pair<uint8_t, int> key;
@@ -107,18 +114,98 @@ std::string CClaimTrieCacheNormalizationFork::normalizeClaimName(const std::stri
 {
     if (!force && !shouldNormalize())
         return name;
+    return normalizeName(name);
+}
+
+// plain ascii is its own NFD form and case folds by lower casing A-Z, most names on chain are
+static bool normalizeAscii(const std::string& name, std::string& normalized)
+{
+    const auto data = name.data();
+    const auto size = name.size();
+    std::size_t i = 0;
+    // eight bytes at a time, a high bit anywhere is utf-8 (or invalid) and left to ICU
+    for (uint64_t word; i + sizeof(word) <= size; i += sizeof(word)) {
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & 0x8080808080808080ULL)
+            return false;
+    }
+    for (; i < size; ++i)
+        if (data[i] & 0x80)
+            return false;
+
+    // branchless so the compiler can vectorize it
+    normalized.resize(size);
+    for (i = 0; i < size; ++i) {
+        const unsigned char c = data[i];
+        normalized[i] = char(c + (unsigned char)(unsigned(c - 'A') < 26u) * ('a' - 'A'));
+    }
+    return true;
+}
+
+// the last non-ascii names normalized, ICU costs far more than a lookup and the names
+// of a block's claims get normalized again for its supports, updates and lookups
+class CNormalizedNames
+{
+public:
+    explicit CNormalizedNames(std::size_t nMaxSize) : nMaxSize(nMaxSize) {}
+
+    bool find(const std::string& name, std::string& normalized)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(name);
+        if (it == index.end())
+            return false;
+        entries.splice(entries.begin(), entries, it->second);
+        normalized = it->second->second;
+        return true;
+    }
+
+    void insert(const std::string& name, const std::string& normalized)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index.count(name))
+            return;
+        entries.emplace_front(name, normalized);
+        index.emplace(name, entries.begin());
+        if (entries.size() > nMaxSize) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
 
-    static std::locale utf8;
-    static bool initialized = false;
-    if (!initialized) {
+private:
+    const std::size_t nMaxSize;
+    std::mutex mutex;
+    // most recently used first
+    std::list<std::pair<std::string, std::string>> entries;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator> index;
+};
+
+std::string CClaimTrieCacheNormalizationFork::normalizeName(const std::string& name)
+{
+    std::string normalized;
+    if (normalizeAscii(name, normalized))
+        return normalized;
+
+    static CNormalizedNames cache(1 << 16);
+    if (cache.find(name, normalized))
+        return normalized;
+    normalized = normalizeUnicode(name);
+    cache.insert(name, normalized);
+    return normalized;
+}
+
+std::string CClaimTrieCacheNormalizationFork::normalizeUnicode(const std::string& name)
+{
+    // initialized once, safe to share between threads afterwards
+    static const std::locale utf8 = []() {
         static boost::locale::localization_backend_manager manager =
             boost::locale::localization_backend_manager::global();
         manager.select("icu");
 
         static boost::locale::generator curLocale(manager);
-        utf8 = curLocale("en_US.UTF8");
-        initialized = true;
-    }
+        return curLocale("en_US.UTF8");
+    }();
 
     std::string normalized;
     try {
@@ -244,6 +331,11 @@ CClaimSupportToName CClaimTrieCacheNormalizationFork::getClaimsForName(const std
     return CClaimTrieCacheExpirationFork::getClaimsForName(normalizeClaimName(name));
 }
 
+CClaimsForNameView CClaimTrieCacheNormalizationFork::viewClaimsForName(const std::string& name) const
+{
+    return CClaimTrieCacheExpirationFork::viewClaimsForName(normalizeClaimName(name));
+}
+
 int CClaimTrieCacheNormalizationFork::getDelayForName(const std::string& name, const uint160& claimId) const
 {
     return CClaimTrieCacheExpirationFork::getDelayForName(normalizeClaimName(name), claimId);
@@ -261,34 +353,111 @@ CClaimTrieCacheHashFork::CClaimTrieCacheHashFork(CClaimTrie* base) : CClaimTrieC
 static const uint256 leafHash = uint256S("0000000000000000000000000000000000000000000000000000000000000002");
 static const uint256 emptyHash = uint256S("0000000000000000000000000000000000000000000000000000000000000003");
 
-std::vector<uint256> getClaimHashes(const CClaimTrieData& data)
+typedef std::pair<std::size_t, std::size_t> hashRangeType; // offset and count of a list of hashes
+
+// merkle roots of many short lists at once, the lists laid out end to end in hashes: each round pairs
+// up the hashes of every list that still has more than one and runs all of those pairs through
+// SHA256D64 together. A list's root ends up at its offset.
+static void computeMerkleRoots(std::vector<uint256>& hashes, std::vector<hashRangeType> lists)
 {
-    std::vector<uint256> hashes;
-    for (auto& claim : data.claims)
-        hashes.push_back(getValueHash(claim.outPoint, data.nHeightOfLastTakeover));
-    return hashes;
-}
+    const auto done = [](const hashRangeType& list) { return list.second < 2; };
+    lists.erase(std::remove_if(lists.begin(), lists.end(), done), lists.end());
 
-template <typename T>
-using iCbType = std::function<uint256(T&)>;
+    std::vector<uint256> pairs;
+    while (!lists.empty()) {
+        pairs.clear();
+        for (auto& list : lists) {
+            auto begin = hashes.begin() + list.first;
+            pairs.insert(pairs.end(), begin, begin + list.second);
+            if (list.second & 1)
+                pairs.push_back(pairs.back());
+        }
+        SHA256D64(pairs[0].begin(), pairs[0].begin(), pairs.size() / 2);
+        auto next = pairs.begin();
+        for (auto& list : lists) {
+            list.second = (list.second + 1) / 2;
+            std::copy(next, next + list.second, hashes.begin() + list.first);
+            next += list.second;
+        }
+        lists.erase(std::remove_if(lists.begin(), lists.end(), done), lists.end());
+    }
+}
 
+/**
+ * Hash the nodes under it a level at a time, deepest first, so the 64 byte inputs of every node on
+ * a level go through SHA256D64 together. A node's hash only takes its children's hashes and its own
+ * claims. With dirtyOnly just the nodes without a hash are visited, each taking the hashes of its
+ * dirty children as they come up from the level below; otherwise every node is hashed from the
+ * stored hashes of its children, and a maxDepth stops at the nodes that deep. onHash gets each
+ * node's hash, children before parents, and stops the walk by returning false.
+ */
 template <typename TIterator>
-uint256 recursiveBinaryTreeHash(TIterator& it, const iCbType<TIterator>& process)
+static bool computeNodeHashes(const TIterator& it, bool dirtyOnly, std::size_t maxDepth, const std::function<bool(TIterator&, const uint256&)>& onHash)
 {
-    std::vector<uint256> childHashes;
-    for (auto& child : it.children())
-        childHashes.emplace_back(process(child));
-
-    std::vector<uint256> claimHashes;
-    if (!it->empty())
-        claimHashes = getClaimHashes(it.data());
-    else if (!it.hasChildren())
-        return {};
+    struct CLevel
+    {
+        std::vector<TIterator> nodes;
+        std::vector<uint256> childHashes;
+        std::vector<hashRangeType> children;
+    };
 
-    auto left = childHashes.empty() ? leafHash : ComputeMerkleRoot(childHashes);
-    auto right = claimHashes.empty() ? emptyHash : ComputeMerkleRoot(claimHashes);
+    std::vector<CLevel> levels;
+    if (!dirtyOnly || it->hash.IsNull()) {
+        levels.emplace_back();
+        levels.back().nodes.push_back(it);
+    }
+    for (std::size_t depth = 0; depth < levels.size(); ++depth) {
+        auto& level = levels[depth];
+        const bool expand = depth + 1 != maxDepth;
+        CLevel next;
+        level.children.reserve(level.nodes.size());
+        for (auto& node : level.nodes) {
+            auto children = node.children();
+            level.children.emplace_back(level.childHashes.size(), children.size());
+            for (auto& child : children) {
+                // a dirty child's slot is filled in once the level below is hashed
+                level.childHashes.push_back(child->hash);
+                if (expand && (!dirtyOnly || child->hash.IsNull()))
+                    next.nodes.push_back(std::move(child));
+            }
+        }
+        if (!next.nodes.empty())
+            levels.push_back(std::move(next));
+    }
 
-    return Hash(left.begin(), left.end(), right.begin(), right.end());
+    std::vector<uint256> pairs, below;
+    for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+        if (dirtyOnly) {
+            auto hash = below.begin();
+            for (auto& childHash : level->childHashes)
+                if (childHash.IsNull())
+                    childHash = *hash++;
+        }
+        computeMerkleRoots(level->childHashes, level->children);
+
+        const auto count = level->nodes.size();
+        pairs.resize(count * 2);
+        for (std::size_t i = 0; i < count; ++i) {
+            auto& node = level->nodes[i];
+            auto& children = level->children[i];
+            pairs[2 * i] = children.second ? level->childHashes[children.first] : leafHash;
+            pairs[2 * i + 1] = node->empty() ? emptyHash : node->getClaimsMerkleRoot();
+        }
+        SHA256D64(pairs[0].begin(), pairs[0].begin(), count);
+        pairs.resize(count);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            auto& node = level->nodes[i];
+            // an empty leaf has no hash
+            if (node->empty() && !level->children[i].second)
+                pairs[i].SetNull();
+            if (!onHash(node, pairs[i]))
+                return false;
+        }
+        below.swap(pairs);
+        *level = CLevel();
+    }
+    return true;
 }
 
 uint256 CClaimTrieCacheHashFork::recursiveComputeMerkleHash(CClaimTrie::iterator& it)
@@ -297,13 +466,19 @@ uint256 CClaimTrieCacheHashFork::recursiveComputeMerkleHash(CClaimTrie::iterator
         return CClaimTrieCacheNormalizationFork::recursiveComputeMerkleHash(it);
 
     using iterator = CClaimTrie::iterator;
-    iCbType<iterator> process = [&process](iterator& it) -> uint256 {
-        if (it->hash.IsNull())
-            it->hash = recursiveBinaryTreeHash(it, process);
-        assert(!it->hash.IsNull());
-        return it->hash;
+    const std::function<bool(iterator&, const uint256&)> store = [](iterator& it, const uint256& hash) {
+        assert(!hash.IsNull());
+        it->hash = hash;
+        return true;
     };
-    return process(it);
+    bool ok;
+    processSubtreesInParallel<iterator>(it, true, [&store](iterator& it) {
+        return computeNodeHashes(it, true, 0, store);
+    }, ok);
+    // store never refuses a hash, so neither does computeNodeHashes
+    ok = ok && computeNodeHashes(it, true, 0, store);
+    assert(ok);
+    return it->hash;
 }
 
 bool CClaimTrieCacheHashFork::recursiveCheckConsistency(CClaimTrie::const_iterator& it, std::string& failed) const
@@ -311,77 +486,60 @@ bool CClaimTrieCacheHashFork::recursiveCheckConsistency(CClaimTrie::const_iterat
     if (nNextHeight < Params().GetConsensus().nAllClaimsInMerkleForkHeight)
         return CClaimTrieCacheNormalizationFork::recursiveCheckConsistency(it, failed);
 
-    struct CRecursiveBreak {};
     using iterator = CClaimTrie::const_iterator;
-    iCbType<iterator> process = [&failed, &process](iterator& it) -> uint256 {
-        if (it->hash.IsNull() || it->hash != recursiveBinaryTreeHash(it, process)) {
-            failed = it.key();
-            throw CRecursiveBreak();
-        }
-        return it->hash;
+    const auto check = [](std::string& failed) -> std::function<bool(iterator&, const uint256&)> {
+        return [&failed](iterator& it, const uint256& hash) {
+            if (it->hash.IsNull() || it->hash != hash) {
+                failed = it.key();
+                return false;
+            }
+            return true;
+        };
     };
 
-    try {
-        process(it);
-    } catch (const CRecursiveBreak&) {
+    std::mutex failedMutex;
+    bool ok;
+    auto depth = processSubtreesInParallel<iterator>(it, false, [&](iterator& it) {
+        std::string subtreeFailed;
+        if (computeNodeHashes(it, false, 0, check(subtreeFailed)))
+            return true;
+        std::lock_guard<std::mutex> lock(failedMutex);
+        if (failed.empty())
+            failed = subtreeFailed;
         return false;
-    }
-    return true;
+    }, ok);
+    if (!ok)
+        return false;
+
+    // the levels above the subtrees checked in parallel
+    return computeNodeHashes(it, false, depth, check(failed));
 }
 
-std::vector<uint256> ComputeMerklePath(const std::vector<uint256>& hashes, uint32_t idx)
+bool CClaimTrieCacheHashFork::checkNodeHash(CClaimTrie::const_iterator& it) const
 {
-    uint32_t count = 0;
-    int matchlevel = -1;
-    bool matchh = false;
-    uint256 inner[32], h;
-    const uint32_t one = 1;
-    std::vector<uint256> res;
-
-    const auto iterateInner = [&](int& level) {
-        for (; !(count & (one << level)); level++) {
-            const auto& ihash = inner[level];
-            if (matchh) {
-                res.push_back(ihash);
-            } else if (matchlevel == level) {
-                res.push_back(h);
-                matchh = true;
-            }
-            h = Hash(ihash.begin(), ihash.end(), h.begin(), h.end());
-        }
-    };
-
-    while (count < hashes.size()) {
-        h = hashes[count];
-        matchh = count == idx;
-        count++;
-        int level = 0;
-        iterateInner(level);
-        // Store the resulting hash at inner position level.
-        inner[level] = h;
-        if (matchh)
-            matchlevel = level;
-    }
-
-    int level = 0;
-    while (!(count & (one << level)))
-        level++;
-
-    h = inner[level];
-    matchh = matchlevel == level;
-
-    while (count != (one << level)) {
-        // If we reach this point, h is an inner value that is not the top.
-        if (matchh)
-            res.push_back(h);
+    if (nNextHeight < Params().GetConsensus().nAllClaimsInMerkleForkHeight)
+        return CClaimTrieCacheNormalizationFork::checkNodeHash(it);
 
-        h = Hash(h.begin(), h.end(), h.begin(), h.end());
-        // Increment count to the value it would have if two entries at this
-        count += (one << level);
-        level++;
-        iterateInner(level);
+    // one level deep: the node is hashed from the hashes its children have
+    using iterator = CClaimTrie::const_iterator;
+    return computeNodeHashes<iterator>(it, false, 1, [](iterator& it, const uint256& hash) {
+        return !it->hash.IsNull() && it->hash == hash;
+    });
+}
+
+// the sibling hashes from the leaf at idx up to the root, a level at a time through SHA256D64
+std::vector<uint256> ComputeMerklePath(std::vector<uint256> hashes, uint32_t idx)
+{
+    std::vector<uint256> path;
+    while (hashes.size() > 1) {
+        if (hashes.size() & 1)
+            hashes.push_back(hashes.back());
+        path.push_back(hashes[idx ^ 1]);
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        idx >>= 1;
     }
-    return res;
+    return path;
 }
 
 bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTrieProof& proof)
@@ -413,9 +571,7 @@ bool CClaimTrieCacheHashFork::getProofForName(const std::string& name, CClaimTri
             childHashes.push_back(child->hash);
         }
 
-        std::vector<uint256> claimHashes;
-        if (!it->empty())
-            claimHashes = getClaimHashes(it.data());
+        const auto claimHashes = it->empty() ? std::vector<uint256>{} : it->getClaimHashes();
 
         // I am on a node; I need a hash(children, claims)
         // if I am the last node on the list, it will be hash(children, x)
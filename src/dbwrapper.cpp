@@ -242,6 +242,39 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper &_parent) : parent(_parent)
+{
+    psnapshot = parent.pdb->GetSnapshot();
+    readoptions = parent.readoptions;
+    readoptions.snapshot = psnapshot;
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    parent.pdb->ReleaseSnapshot(psnapshot);
+}
+
+CDBIterator *CDBSnapshot::NewIterator() const
+{
+    leveldb::ReadOptions iteroptions = parent.iteroptions;
+    iteroptions.snapshot = psnapshot;
+    return new CDBIterator(parent, parent.pdb->NewIterator(iteroptions));
+}
+
+void CDBBatch::ForEach(const std::function<void(const leveldb::Slice& key, const leveldb::Slice* value)>& fn) const
+{
+    class Handler : public leveldb::WriteBatch::Handler
+    {
+    public:
+        explicit Handler(const std::function<void(const leveldb::Slice&, const leveldb::Slice*)>& fn) : fn(fn) {}
+        void Put(const leveldb::Slice& key, const leveldb::Slice& value) override { fn(key, &value); }
+        void Delete(const leveldb::Slice& key) override { fn(key, nullptr); }
+    private:
+        const std::function<void(const leveldb::Slice&, const leveldb::Slice*)>& fn;
+    } handler(fn);
+    dbwrapper_private::HandleError(batch.Iterate(&handler));
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
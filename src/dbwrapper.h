@@ -13,6 +13,8 @@
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <functional>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -92,6 +94,20 @@ public:
         return true;
     }
 
+    /** The raw key as a stream, as written by serializing the key */
+    CDataStream GetKeyStream() {
+        leveldb::Slice slKey = piter->key();
+        return CDataStream(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+    }
+
+    /** The value as a stream, left to be deserialized later (possibly on another thread) */
+    CDataStream GetValueStream() {
+        leveldb::Slice slValue = piter->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+        return ssValue;
+    }
+
     unsigned int GetValueSize() {
         return piter->value().size();
     }
@@ -103,6 +119,7 @@ class CDBBatch;
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -203,6 +220,20 @@ public:
         return true;
     }
 
+    /** Bring the entry under key into the database caches; unlike Read and Exists this is safe next to other reads */
+    template <typename K>
+    void Prefetch(const K& key) const
+    {
+        CDataStream ssPrefetchKey(SER_DISK, CLIENT_VERSION);
+        ssPrefetchKey << key;
+        leveldb::Slice slKey(ssPrefetchKey.data(), ssPrefetchKey.size());
+
+        std::string strValue;
+        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        if (!status.ok() && !status.IsNotFound())
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+    }
+
     template <typename K>
     bool Erase(const K& key, bool fSync = false);
 
@@ -263,6 +294,52 @@ public:
 
 };
 
+/**
+ * Consistent read-only view of a CDBWrapper as of the moment it was taken.
+ * Unlike CDBWrapper::Read, reads through a snapshot may be made from any thread.
+ */
+class CDBSnapshot
+{
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *psnapshot;
+    leveldb::ReadOptions readoptions;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper &_parent);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+    CDBIterator *NewIterator() const;
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+
+        std::string strValue;
+        leveldb::Status status = parent.pdb->Get(readoptions, slKey, &strValue);
+        if (!status.ok()) {
+            if (status.IsNotFound())
+                return false;
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+            dbwrapper_private::HandleError(status);
+        }
+        try {
+            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue.Xor(parent.obfuscate_key);
+            ssValue >> value;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+};
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -301,6 +378,14 @@ public:
         ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
 
+        WriteRaw(slKey, slValue);
+        ssKey.clear();
+        ssValue.clear();
+    }
+
+    //! Write a key and value that are already serialized, the value obfuscated for parent
+    void WriteRaw(const leveldb::Slice& slKey, const leveldb::Slice& slValue)
+    {
         batch.Put(slKey, slValue);
         // LevelDB serializes writes as:
         // - byte: header
@@ -310,8 +395,6 @@ public:
         // - byte[]: value
         // The formula below assumes the key and value are both less than 16k.
         size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
-        ssKey.clear();
-        ssValue.clear();
     }
 
     template <typename K>
@@ -320,6 +403,13 @@ public:
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
+        EraseRaw(slKey);
+        ssKey.clear();
+    }
+
+    //! Erase a key that is already serialized
+    void EraseRaw(const leveldb::Slice& slKey)
+    {
         batch.Delete(slKey);
         // LevelDB serializes erases as:
         // - byte: header
@@ -327,9 +417,14 @@ public:
         // - byte[]: key
         // The formula below assumes the key is less than 16kB.
         size_estimate += 2 + (slKey.size() > 127) + slKey.size();
-        ssKey.clear();
     }
 
+    /**
+     * Call fn for every entry in the batch, in the order they were added, with the serialized key
+     * and the obfuscated value of a write, or a null value for an erase
+     */
+    void ForEach(const std::function<void(const leveldb::Slice& key, const leveldb::Slice* value)>& fn) const;
+
     size_t SizeEstimate() const { return size_estimate; }
 };
 
@@ -0,0 +1,211 @@
+// Copyright (c) 2015-2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#include <chainparams.h>
+#include <claimtrie.h>
+#include <compat/endian.h>
+#include <index/claimhistoryindex.h>
+#include <index/claimindex.h>
+#include <nameclaim.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+constexpr char DB_CLAIMHISTORY = 'h';
+
+std::unique_ptr<ClaimHistoryIndex> g_claimhistoryindex;
+
+namespace {
+
+/** The height is big endian so that the events of a claim are in block order in the database */
+struct CClaimHistoryKey
+{
+    uint160 claimId;
+    int nHeight;
+    COutPoint outPoint;
+
+    CClaimHistoryKey() : nHeight(0) {}
+    CClaimHistoryKey(const uint160& claimId, int nHeight, const COutPoint& outPoint)
+        : claimId(claimId), nHeight(nHeight), outPoint(outPoint) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ::Serialize(s, DB_CLAIMHISTORY);
+        ::Serialize(s, claimId);
+        uint32_t height = htobe32(uint32_t(nHeight));
+        s.write((const char*)&height, sizeof(height));
+        ::Serialize(s, outPoint);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix;
+        ::Unserialize(s, prefix);
+        if (prefix != DB_CLAIMHISTORY)
+            throw std::ios_base::failure("not a claim history key");
+        ::Unserialize(s, claimId);
+        uint32_t height;
+        s.read((char*)&height, sizeof(height));
+        nHeight = int(be32toh(height));
+        ::Unserialize(s, outPoint);
+    }
+};
+
+}
+
+/**
+ * Access to the claimhistoryindex database (indexes/claimhistoryindex/)
+ */
+class ClaimHistoryIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+    ~DB() override {}
+
+    /// Write a batch of events to the DB.
+    bool WriteEvents(const std::vector<std::pair<CClaimHistoryKey, CClaimHistoryEvent>>& events);
+};
+
+ClaimHistoryIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "claimhistoryindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool ClaimHistoryIndex::DB::WriteEvents(const std::vector<std::pair<CClaimHistoryKey, CClaimHistoryEvent>>& events)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : events) {
+        batch.Write(entry.first, entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+ClaimHistoryIndex::ClaimHistoryIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ClaimHistoryIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ClaimHistoryIndex::~ClaimHistoryIndex() {}
+
+bool ClaimHistoryIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // only the genesis block has no undo data and it has no claims
+    if (!pindex->pprev)
+        return true;
+
+    CBlockUndo blockUndo;
+    if (!UndoReadFromDisk(blockUndo, pindex))
+        return error("%s: no undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+
+    const auto& consensus = Params().GetConsensus();
+    const bool allowSupportMetadata = pindex->nHeight >= consensus.nAllClaimsInMerkleForkHeight;
+    const auto normalize = [&](const std::string& name) {
+        return pindex->nHeight > consensus.nNormalizedNameForkHeight ? CClaimTrieCacheNormalizationFork::normalizeName(name) : name;
+    };
+
+    std::vector<std::pair<CClaimHistoryKey, CClaimHistoryEvent>> events;
+    const auto addEvent = [&](uint8_t type, const uint160& claimId, const COutPoint& outPoint, const CTxOut& txout,
+                              int op, const std::vector<std::vector<unsigned char>>& vvchParams) {
+        CClaimHistoryEvent event;
+        event.type = type;
+        event.name.assign(vvchParams[0].begin(), vvchParams[0].end());
+        if (op == OP_CLAIM_NAME)
+            event.value.assign(vvchParams[1].begin(), vvchParams[1].end());
+        else if (vvchParams.size() > 2)
+            event.value.assign(vvchParams[2].begin(), vvchParams[2].end());
+        event.outPoint = outPoint;
+        event.nAmount = txout.nValue;
+        event.nHeight = pindex->nHeight;
+        event.hashBlock = pindex->GetBlockHash();
+        events.emplace_back(CClaimHistoryKey(claimId, pindex->nHeight, outPoint), std::move(event));
+    };
+
+    for (std::size_t i = 1; i < block.vtx.size(); ++i) {
+        const auto& tx = *block.vtx[i];
+        const auto& txUndo = blockUndo.vtxundo[i - 1];
+
+        // the claims this transaction spends, an update takes its claim off the list
+        struct SpentClaim {
+            std::size_t nIn;
+            uint160 claimId;
+            std::string name;
+        };
+        std::vector<SpentClaim> spentClaims;
+        for (std::size_t j = 0; j < tx.vin.size(); ++j) {
+            const CTxOut& txout = txUndo.vprevout[j].txout;
+            int op;
+            std::vector<std::vector<unsigned char>> vvchParams;
+            if (!DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+                continue;
+            // the claim trie has let go of an expired output, spending it neither abandons nor updates anything
+            if (ClaimExpirationHeight(txUndo.vprevout[j].nHeight) < pindex->nHeight)
+                continue;
+            if (op == OP_SUPPORT_CLAIM) {
+                addEvent(CClaimHistoryEvent::SUPPORT_ABANDONED, uint160(vvchParams[1]), tx.vin[j].prevout, txout, op, vvchParams);
+                continue;
+            }
+            uint160 claimId = op == OP_CLAIM_NAME ? ClaimIdHash(tx.vin[j].prevout.hash, tx.vin[j].prevout.n) : uint160(vvchParams[1]);
+            spentClaims.push_back({j, claimId, normalize(std::string(vvchParams[0].begin(), vvchParams[0].end()))});
+        }
+
+        for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+            const CTxOut& txout = tx.vout[j];
+            int op;
+            std::vector<std::vector<unsigned char>> vvchParams;
+            if (!DecodeClaimScript(txout.scriptPubKey, op, vvchParams, allowSupportMetadata))
+                continue;
+            const COutPoint outPoint(tx.GetHash(), j);
+            if (op == OP_CLAIM_NAME) {
+                addEvent(CClaimHistoryEvent::CLAIMED, ClaimIdHash(tx.GetHash(), j), outPoint, txout, op, vvchParams);
+            } else if (op == OP_SUPPORT_CLAIM) {
+                addEvent(CClaimHistoryEvent::SUPPORTED, uint160(vvchParams[1]), outPoint, txout, op, vvchParams);
+            } else {
+                uint160 claimId(vvchParams[1]);
+                auto name = normalize(std::string(vvchParams[0].begin(), vvchParams[0].end()));
+                auto it = std::find_if(spentClaims.begin(), spentClaims.end(), [&](const SpentClaim& spent) {
+                    return spent.claimId == claimId && spent.name == name;
+                });
+                if (it == spentClaims.end())
+                    continue;
+                spentClaims.erase(it);
+                addEvent(CClaimHistoryEvent::UPDATED, claimId, outPoint, txout, op, vvchParams);
+            }
+        }
+
+        for (auto& spent : spentClaims) {
+            const CTxOut& txout = txUndo.vprevout[spent.nIn].txout;
+            int op;
+            std::vector<std::vector<unsigned char>> vvchParams;
+            DecodeClaimScript(txout.scriptPubKey, op, vvchParams);
+            addEvent(CClaimHistoryEvent::ABANDONED, spent.claimId, tx.vin[spent.nIn].prevout, txout, op, vvchParams);
+        }
+    }
+    return m_db->WriteEvents(events);
+}
+
+BaseIndex::DB& ClaimHistoryIndex::GetDB() const { return *m_db; }
+
+void ClaimHistoryIndex::GetHistory(const uint160& claimId, int nStartHeight, std::size_t nLimit, std::vector<CClaimHistoryEvent>& events) const
+{
+    std::unique_ptr<CDBIterator> cursor(m_db->NewIterator());
+    LOCK(cs_main);
+    for (cursor->Seek(CClaimHistoryKey(claimId, std::max(nStartHeight, 0), COutPoint(uint256(), 0))); cursor->Valid(); cursor->Next()) {
+        CClaimHistoryKey key;
+        if (!cursor->GetKey(key) || key.claimId != claimId)
+            break;
+        if (events.size() >= nLimit && (events.empty() || key.nHeight != events.back().nHeight))
+            break;
+        CClaimHistoryEvent event;
+        if (!cursor->GetValue(event)) {
+            error("%s: cannot parse claim history event", __func__);
+            break;
+        }
+        // the block that wrote the event may have been disconnected since
+        const CBlockIndex* pindex = chainActive[event.nHeight];
+        if (pindex && pindex->GetBlockHash() == event.hashBlock)
+            events.push_back(std::move(event));
+    }
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2015-2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#ifndef BITCOIN_INDEX_CLAIMHISTORYINDEX_H
+#define BITCOIN_INDEX_CLAIMHISTORYINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <string>
+#include <vector>
+
+/** Something a block did to a claim */
+struct CClaimHistoryEvent
+{
+    enum Type : uint8_t {
+        CLAIMED,
+        UPDATED,
+        ABANDONED, // the claim was spent without being updated
+        SUPPORTED,
+        SUPPORT_ABANDONED,
+    };
+
+    uint8_t type = CLAIMED;
+    std::string name; // as written in the script, not normalized
+    std::string value; // the claim value or support metadata, raw bytes
+    COutPoint outPoint; // the output created or, for an abandon, spent
+    CAmount nAmount = 0;
+    int nHeight = -1;
+    uint256 hashBlock;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(type);
+        READWRITE(name);
+        READWRITE(value);
+        READWRITE(outPoint);
+        READWRITE(nAmount);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+    }
+};
+
+/**
+ * ClaimHistoryIndex keeps every claim, update, support and abandon that touched a claimId, in
+ * block order, so the life of a claim can be read back without replaying the chain. Like the
+ * claim trie, an update only counts when its transaction spends the claim it updates before it
+ * expires, and spending an expired output abandons nothing. Events of blocks that were
+ * disconnected since are skipped when they are read.
+ */
+class ClaimHistoryIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "claimhistoryindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ClaimHistoryIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ClaimHistoryIndex() override;
+
+    /// Look up the history of a claim in the active chain.
+    ///
+    /// @param[in]   claimId  The claim.
+    /// @param[in]   nStartHeight  Skip the events of blocks below this height.
+    /// @param[in]   nLimit  Stop after this many events, though the events of a block are never
+    ///                      split so the next page can start at the height after the last one.
+    /// @param[out]  events  The events in block order.
+    void GetHistory(const uint160& claimId, int nStartHeight, std::size_t nLimit, std::vector<CClaimHistoryEvent>& events) const;
+};
+
+/// The global claim history index, may be null.
+extern std::unique_ptr<ClaimHistoryIndex> g_claimhistoryindex;
+
+#endif // BITCOIN_INDEX_CLAIMHISTORYINDEX_H
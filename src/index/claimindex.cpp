@@ -0,0 +1,146 @@
+// Copyright (c) 2015-2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#include <chainparams.h>
+#include <index/claimindex.h>
+#include <nameclaim.h>
+#include <util.h>
+#include <validation.h>
+
+#include <map>
+
+constexpr char DB_CLAIMINDEX = 'c';
+
+std::unique_ptr<ClaimIndex> g_claimindex;
+
+/**
+ * Access to the claimindex database (indexes/claimindex/)
+ *
+ * Records are keyed by outpoint. Spending an output rewrites its record, so a lookup is always a
+ * single read.
+ */
+class ClaimIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+    ~DB() override {}
+
+    /// Read the record of an output. Returns false if the output is not indexed.
+    bool ReadRecord(const COutPoint& outPoint, CClaimIndexRecord& record) const;
+
+    /// Write a batch of records to the DB.
+    bool WriteRecords(const std::map<COutPoint, CClaimIndexRecord>& records);
+};
+
+ClaimIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "claimindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool ClaimIndex::DB::ReadRecord(const COutPoint& outPoint, CClaimIndexRecord& record) const
+{
+    return Read(std::make_pair(DB_CLAIMINDEX, outPoint), record);
+}
+
+bool ClaimIndex::DB::WriteRecords(const std::map<COutPoint, CClaimIndexRecord>& records)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : records) {
+        batch.Write(std::make_pair(DB_CLAIMINDEX, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+int ClaimExpirationHeight(int nHeight)
+{
+    const auto& consensus = Params().GetConsensus();
+    int64_t nExpirationHeight = nHeight + consensus.nOriginalClaimExpirationTime;
+    if (nExpirationHeight >= consensus.nExtendedClaimExpirationForkHeight)
+        nExpirationHeight = nHeight + consensus.nExtendedClaimExpirationTime;
+    return int(nExpirationHeight);
+}
+
+ClaimIndex::ClaimIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ClaimIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ClaimIndex::~ClaimIndex() {}
+
+bool ClaimIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    const uint256 hashBlock = pindex->GetBlockHash();
+    const bool allowSupportMetadata = pindex->nHeight >= Params().GetConsensus().nAllClaimsInMerkleForkHeight;
+
+    std::map<COutPoint, CClaimIndexRecord> records;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const auto& txin : tx->vin) {
+                auto it = records.find(txin.prevout);
+                if (it == records.end()) {
+                    CClaimIndexRecord record;
+                    if (!m_db->ReadRecord(txin.prevout, record))
+                        continue;
+                    it = records.emplace(txin.prevout, std::move(record)).first;
+                }
+                it->second.nSpentHeight = pindex->nHeight;
+                it->second.hashSpentBlock = hashBlock;
+            }
+        }
+
+        for (uint32_t i = 0; i < tx->vout.size(); ++i) {
+            const CTxOut& txout = tx->vout[i];
+            int op;
+            std::vector<std::vector<unsigned char>> vvchParams;
+            if (!DecodeClaimScript(txout.scriptPubKey, op, vvchParams, allowSupportMetadata))
+                continue;
+
+            CClaimIndexRecord& record = records[COutPoint(tx->GetHash(), i)];
+            record.op = op;
+            record.name.assign(vvchParams[0].begin(), vvchParams[0].end());
+            if (op == OP_CLAIM_NAME) {
+                record.claimId = ClaimIdHash(tx->GetHash(), i);
+                record.value.assign(vvchParams[1].begin(), vvchParams[1].end());
+            } else {
+                record.claimId = uint160(vvchParams[1]);
+                if (vvchParams.size() > 2)
+                    record.value.assign(vvchParams[2].begin(), vvchParams[2].end());
+            }
+            record.script = StripClaimScriptPrefix(txout.scriptPubKey);
+            record.nAmount = txout.nValue;
+            record.nHeight = pindex->nHeight;
+            record.hashBlock = hashBlock;
+        }
+    }
+    return m_db->WriteRecords(records);
+}
+
+BaseIndex::DB& ClaimIndex::GetDB() const { return *m_db; }
+
+bool ClaimIndex::FindClaim(const COutPoint& outPoint, CClaimIndexRecord& record) const
+{
+    if (!m_db->ReadRecord(outPoint, record))
+        return false;
+
+    // the blocks that wrote the record may have been disconnected since
+    LOCK(cs_main);
+    const CBlockIndex* pindex = chainActive[record.nHeight];
+    if (!pindex || pindex->GetBlockHash() != record.hashBlock)
+        return false;
+    if (record.IsSpent()) {
+        pindex = chainActive[record.nSpentHeight];
+        if (!pindex || pindex->GetBlockHash() != record.hashSpentBlock) {
+            record.nSpentHeight = -1;
+            record.hashSpentBlock.SetNull();
+        }
+    }
+    return true;
+}
+
+bool ClaimIndex::IsExpired(const CClaimIndexRecord& record)
+{
+    // a spend is taken out of the claim trie before the block expires anything
+    if (record.IsSpent())
+        return record.ExpirationHeight() < record.nSpentHeight;
+    LOCK(cs_main);
+    return record.ExpirationHeight() <= chainActive.Height();
+}
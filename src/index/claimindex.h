@@ -0,0 +1,98 @@
+// Copyright (c) 2015-2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#ifndef BITCOIN_INDEX_CLAIMINDEX_H
+#define BITCOIN_INDEX_CLAIMINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <string>
+
+/// The height of the block that expires a claim or support output made at nHeight unless it is spent
+/// first. The expiration fork extended the outputs that had not expired by then.
+int ClaimExpirationHeight(int nHeight);
+
+/** What the claim index keeps of a claim, update or support output */
+struct CClaimIndexRecord
+{
+    int op = 0; // OP_CLAIM_NAME, OP_UPDATE_CLAIM or OP_SUPPORT_CLAIM
+    std::string name; // as written in the script, not normalized
+    std::string value; // the claim value or support metadata, raw bytes
+    uint160 claimId; // the claim or, for a support, the supported one
+    CScript script; // the output script without its claim prefix
+    CAmount nAmount = 0;
+    int nHeight = -1;
+    uint256 hashBlock;
+    int nSpentHeight = -1; // -1 while unspent
+    uint256 hashSpentBlock;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(op);
+        READWRITE(name);
+        READWRITE(value);
+        READWRITE(claimId);
+        READWRITE(*(CScriptBase*)(&script));
+        READWRITE(nAmount);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nSpentHeight);
+        READWRITE(hashSpentBlock);
+    }
+
+    bool IsSpent() const { return nSpentHeight >= 0; }
+
+    /// The height of the block that expires the output unless it is spent first.
+    int ExpirationHeight() const { return ClaimExpirationHeight(nHeight); }
+};
+
+/**
+ * ClaimIndex keeps the metadata of every claim, update and support output by its outpoint,
+ * whether or not it is still unspent, so it can be read back without the UTXO set or the blocks.
+ * Records written by blocks that were disconnected since are checked against the active chain
+ * when they are read.
+ */
+class ClaimIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "claimindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ClaimIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ClaimIndex() override;
+
+    /// Look up a claim, update or support output.
+    ///
+    /// @param[in]   outPoint  The output.
+    /// @param[out]  record  Its metadata as of the active chain.
+    /// @return  true if the output is in a block of the active chain, false otherwise
+    bool FindClaim(const COutPoint& outPoint, CClaimIndexRecord& record) const;
+
+    /// Whether the output was removed from the claim trie by expiring as of the active chain.
+    static bool IsExpired(const CClaimIndexRecord& record);
+};
+
+/// The global claim index, may be null.
+extern std::unique_ptr<ClaimIndex> g_claimindex;
+
+#endif // BITCOIN_INDEX_CLAIMINDEX_H
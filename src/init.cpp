@@ -20,6 +20,8 @@
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
+#include <index/claimhistoryindex.h>
+#include <index/claimindex.h>
 #include <index/txindex.h>
 #include <key.h>
 #include <lbry.h>
@@ -171,6 +173,9 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
 
+//! whether the claim trie was loaded and found consistent, only then a clean shutdown is recorded for it
+static std::atomic<bool> fClaimTrieConsistent(false);
+
 void Interrupt()
 {
     InterruptHTTPServer();
@@ -184,6 +189,12 @@ void Interrupt()
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_claimindex) {
+        g_claimindex->Interrupt();
+    }
+    if (g_claimhistoryindex) {
+        g_claimhistoryindex->Interrupt();
+    }
 }
 
 void Shutdown()
@@ -213,6 +224,8 @@ void Shutdown()
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
     if (g_connman) g_connman->Stop();
     if (g_txindex) g_txindex->Stop();
+    if (g_claimindex) g_claimindex->Stop();
+    if (g_claimhistoryindex) g_claimhistoryindex->Stop();
 
     StopTorControl();
 
@@ -226,6 +239,8 @@ void Shutdown()
     peerLogic.reset();
     g_connman.reset();
     g_txindex.reset();
+    g_claimindex.reset();
+    g_claimhistoryindex.reset();
 
     if (g_is_mempool_loaded && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool();
@@ -267,6 +282,11 @@ void Shutdown()
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        if (pclaimTrie != nullptr && chainActive.Tip() != nullptr && fClaimTrieConsistent) {
+            // lets the next startup skip rechecking the whole claim trie
+            CClaimTrieCache trieCache(pclaimTrie);
+            trieCache.writeCleanShutdown();
+        }
         delete pclaimTrie;
         pclaimTrie = nullptr;
     }
@@ -371,6 +391,14 @@ void SetupServerArgs()
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtriehashthreads=<n>", strprintf("Set the number of claim trie hashing threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
+        -GetNumCores(), MAX_CLAIMTRIE_HASH_THREADS, DEFAULT_CLAIMTRIE_HASH_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadclaimtrie=<file>", "Replace the claim trie with a snapshot written by dumpclaimtrie at the same chain tip and check it at startup; skipped once the claim trie holds the snapshot or the chain is past its block", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimhistoryindex", strprintf("Maintain an index of the updates, supports and abandons of every claim, used by the getclaimhistory rpc call (default: %u)", DEFAULT_CLAIMHISTORYINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimindex", strprintf("Maintain an index of every claim, update and support output, used by the claim rpc calls to describe spent and expired claims (default: %u)", DEFAULT_CLAIMINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtriehistory=<n>", strprintf("Keep the claim trie history of the last <n> blocks so claim RPCs can look them up without rolling back (0 to keep none, default: %d)", DEFAULT_CLAIMTRIE_HISTORY), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtrieranking", strprintf("Keep the names ranked by the effective amount of their controlling claim for the gettopclaims rpc call, at roughly 120 bytes of memory a name (default: %u)", DEFAULT_CLAIMTRIE_RANKING), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-claimtriewritebuffer=<n>", strprintf("Keep up to <n> megabytes of claim trie database writes in memory during the initial sync and write them out with the coins (0 to write every block, default: %d)", DEFAULT_CLAIMTRIE_WRITE_BUFFER), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-claimtriecache=<n>", strprintf("Set claim trie cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
@@ -388,7 +416,7 @@ void SetupServerArgs()
 #else
     hidden_args.emplace_back("-pid");
 #endif
-    gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+    gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex, -claimindex, -claimhistoryindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", false, OptionsCategory::OPTIONS);
@@ -450,14 +478,17 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubclaimtrie=<address>", "Enable publish claim trie changes of each connected or disconnected block in <address>", false, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubclaimtrie=<address>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-checkclaimtrie=<n>", strprintf("How thoroughly the claim trie is verified at startup after a clean shutdown (0 = compare the root hash only, 1 = also recheck all node hashes in the background, 2 = recheck all node hashes before starting, default: %u)", DEFAULT_CHECKCLAIMTRIE), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checklevel=<n>", strprintf("How thorough the block verification of -checkblocks is (0-4, default: %u)", DEFAULT_CHECKLEVEL), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
@@ -711,6 +742,30 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
     g_is_mempool_loaded = !ShutdownRequested();
 }
 
+/**
+ * Recheck the node hashes of a claim trie that was trusted after a clean shutdown, with cs_main held
+ * for one subtree at a time. Until it finishes the shutdown leaves no record to trust the trie by.
+ */
+static void ThreadCheckClaimTrie()
+{
+    RenameThread("lbrycrd-checktrie");
+    const int64_t nStart = GetTimeMillis();
+    bool fFinished;
+    const bool fConsistent = pclaimTrie->checkInParts(cs_main, 4096, []() {
+        boost::this_thread::interruption_point();
+        return ShutdownRequested();
+    }, fFinished);
+    if (fConsistent) {
+        if (fFinished)
+            LogPrintf("Claim trie checked in the background in %dms\n", GetTimeMillis() - nStart);
+        return;
+    }
+    fClaimTrieConsistent = false;
+    LogPrintf("Error: the claim trie is inconsistent\n");
+    uiInterface.ThreadSafeMessageBox(_("The claim trie is inconsistent. You will need to rebuild the database using -reindex-chainstate."), "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
 /** Sanity checks
  *  Ensure that Bitcoin is running in a usable environment with all
  *  necessary library support.
@@ -940,6 +995,10 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-claimindex", DEFAULT_CLAIMINDEX))
+            return InitError(_("Prune mode is incompatible with -claimindex."));
+        if (gArgs.GetBoolArg("-claimhistoryindex", DEFAULT_CLAIMHISTORYINDEX))
+            return InitError(_("Prune mode is incompatible with -claimhistoryindex."));
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1057,6 +1116,18 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // same for -claimtriehashthreads
+    nClaimTrieHashThreads = gArgs.GetArg("-claimtriehashthreads", DEFAULT_CLAIMTRIE_HASH_THREADS);
+    if (nClaimTrieHashThreads <= 0)
+        nClaimTrieHashThreads += GetNumCores();
+    if (nClaimTrieHashThreads <= 1)
+        nClaimTrieHashThreads = 0;
+    else if (nClaimTrieHashThreads > MAX_CLAIMTRIE_HASH_THREADS)
+        nClaimTrieHashThreads = MAX_CLAIMTRIE_HASH_THREADS;
+
+    int64_t nClaimTrieWriteBufferMB = gArgs.GetArg("-claimtriewritebuffer", DEFAULT_CLAIMTRIE_WRITE_BUFFER);
+    nClaimTrieWriteBuffer = std::max<int64_t>(0, std::min(nClaimTrieWriteBufferMB, nMaxDbCache)) << 20;
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1266,6 +1337,13 @@ bool AppInitMain()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // like the script check threads these are stopped when Shutdown interrupts threadGroup
+    LogPrintf("Using %u threads for claim trie hashing\n", nClaimTrieHashThreads);
+    if (nClaimTrieHashThreads) {
+        for (int i=0; i<nClaimTrieHashThreads-1; i++)
+            threadGroup.create_thread(&ThreadClaimTrieHash);
+    }
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1401,6 +1479,8 @@ bool AppInitMain()
 
     if (g_zmq_notification_interface) {
         RegisterValidationInterface(g_zmq_notification_interface);
+        // the claim trie changes are only worked out for a notifier that is there to send them
+        fClaimTrieChanges = g_zmq_notification_interface->HasNotifier("pubclaimtrie");
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1423,6 +1503,10 @@ bool AppInitMain()
     nTotalCache -= nBlockTreeDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t nClaimIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-claimindex", DEFAULT_CLAIMINDEX) ? nMaxClaimIndexCache << 20 : 0);
+    nTotalCache -= nClaimIndexCache;
+    int64_t nClaimHistoryIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-claimhistoryindex", DEFAULT_CLAIMHISTORYINDEX) ? nMaxClaimHistoryIndexCache << 20 : 0);
+    nTotalCache -= nClaimHistoryIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1434,11 +1518,19 @@ bool AppInitMain()
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (gArgs.GetBoolArg("-claimindex", DEFAULT_CLAIMINDEX)) {
+        LogPrintf("* Using %.1fMiB for claim index database\n", nClaimIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-claimhistoryindex", DEFAULT_CLAIMHISTORYINDEX)) {
+        LogPrintf("* Using %.1fMiB for claim history index database\n", nClaimHistoryIndexCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     g_memfileSize = gArgs.GetArg("-memfile", 0u);
 
+    const int nCheckClaimTrie = gArgs.GetArg("-checkclaimtrie", DEFAULT_CHECKCLAIMTRIE);
+    bool fCheckClaimTrieInBackground = false;
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
@@ -1463,7 +1555,8 @@ bool AppInitMain()
                 int64_t trieCacheMB = gArgs.GetArg("-claimtriecache", nDefaultDbCache);
                 trieCacheMB = std::min(trieCacheMB, nMaxDbCache);
                 trieCacheMB = std::max(trieCacheMB, nMinDbCache);
-                pclaimTrie = new CClaimTrie(false, fReindex || fReindexChainState, 32, trieCacheMB);
+                pclaimTrie = new CClaimTrie(false, fReindex || fReindexChainState, 32, trieCacheMB, gArgs.GetArg("-claimtriehistory", DEFAULT_CLAIMTRIE_HISTORY),
+                    gArgs.GetBoolArg("-claimtrieranking", DEFAULT_CLAIMTRIE_RANKING));
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1538,11 +1631,23 @@ bool AppInitMain()
                 }
 
                 CClaimTrieCache trieCache(pclaimTrie);
-                if (!trieCache.ReadFromDisk(chainActive.Tip()))
-                {
-                    strLoadError = _("Error loading the claim trie from disk");
-                    break;
+                const auto snapshotPath = fs::absolute(gArgs.GetArg("-loadclaimtrie", ""));
+                if (gArgs.IsArgSet("-loadclaimtrie") && trieCache.needsSnapshot(snapshotPath, chainActive.Tip())) {
+                    if (!trieCache.loadSnapshot(snapshotPath, chainActive.Tip())) {
+                        strLoadError = _("Error loading the claim trie snapshot");
+                        break;
+                    }
+                } else {
+                    // the node hashes left by a clean shutdown at this tip can be trusted
+                    const bool fTrustClaimTrie = trieCache.readCleanShutdown(chainActive.Tip()) && nCheckClaimTrie < 2;
+                    fCheckClaimTrieInBackground = fTrustClaimTrie && nCheckClaimTrie == 1;
+                    if (!trieCache.ReadFromDisk(chainActive.Tip(), !fTrustClaimTrie, fCheckClaimTrieInBackground))
+                    {
+                        strLoadError = _("Error loading the claim trie from disk");
+                        break;
+                    }
                 }
+                fClaimTrieConsistent = true;
 
                 if (!fReset) {
                     // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
@@ -1627,6 +1732,14 @@ bool AppInitMain()
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
+    if (gArgs.GetBoolArg("-claimindex", DEFAULT_CLAIMINDEX)) {
+        g_claimindex = MakeUnique<ClaimIndex>(nClaimIndexCache, false, fReindex);
+        g_claimindex->Start();
+    }
+    if (gArgs.GetBoolArg("-claimhistoryindex", DEFAULT_CLAIMHISTORYINDEX)) {
+        g_claimhistoryindex = MakeUnique<ClaimHistoryIndex>(nClaimHistoryIndexCache, false, fReindex);
+        g_claimhistoryindex->Start();
+    }
 
     // ********************************************************* Step 9: load wallet
     if (!g_wallet_init_interface.Open()) return false;
@@ -1676,6 +1789,9 @@ bool AppInitMain()
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    if (fCheckClaimTrieInBackground)
+        threadGroup.create_thread(&ThreadCheckClaimTrie);
+
     // Wait for genesis block to be processed
     {
         WaitableLock lock(cs_GenesisWait);
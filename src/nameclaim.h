@@ -10,11 +10,11 @@
 
 // This is the minimum claim fee per character in the name of an OP_CLAIM_NAME command that must
 // be attached to transactions for it to be accepted into the memory pool.
-// Rationale: current implementation of the claim trie uses more memory for longer name claims
-// due to the fact that each character is assigned a trie node regardless of whether it contains
-// any claims or not. In the future, we can switch to a radix tree implementation where
-// empty nodes do not take up any memory and the minimum fee can be priced on a per claim
-// basis.
+// Rationale: the original implementation of the claim trie assigned a trie node to each character
+// of a name regardless of whether it contained any claims or not. The trie is now path compressed
+// (see CPrefixTrie), so empty single-child runs take up no nodes; the fee is kept per character
+// as it is a mempool policy that the network relies on, but it could be priced on a per claim
+// basis in the future.
 #define MIN_FEE_PER_NAMECLAIM_CHAR 200000
 
 // This is the max claim script size in bytes, not including the script pubkey part of the script.
@@ -4,9 +4,9 @@
 #include <lbry.h>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <prefixtrie.h>
 
-#include <boost/interprocess/allocators/private_node_allocator.hpp>
 #include <boost/interprocess/indexes/null_index.hpp>
 #include <boost/interprocess/managed_mapped_file.hpp>
 
@@ -18,9 +18,6 @@ typedef bip::basic_managed_mapped_file <
     bip::null_index
 > managed_mapped_file;
 
-template <typename T>
-using node_allocator = bip::private_node_allocator<T, managed_mapped_file::segment_manager>;
-
 static managed_mapped_file::segment_manager* segmentManager()
 {
     struct CSharedMemoryFile
@@ -48,37 +45,111 @@ static managed_mapped_file::segment_manager* segmentManager()
     return shem.segmentManager();
 }
 
-template <typename T>
-static node_allocator<T>& nodeAllocator()
+// tries are built and freed on the hash, background check and RPC threads, while the segment manager
+// does no locking of its own (null_mutex_family)
+static std::mutex memfileMutex;
+
+static void* allocateSlab(std::size_t bytes)
 {
-    static node_allocator<T> allocator(segmentManager());
-    return allocator;
+    if (g_memfileSize > 0) {
+        std::lock_guard<std::mutex> lock(memfileMutex);
+        static bool memfile = true;
+        if (memfile) {
+            try {
+                return segmentManager()->allocate(bytes);
+            }
+            catch (const bip::bad_alloc&) {
+                memfile = false; // in case we fill up the memfile
+                LogPrint(BCLog::BENCH, "WARNING: The memfile is full; reverting to the RAM allocator for trie nodes.\n");
+            }
+        }
+    }
+    return ::operator new(bytes);
 }
 
-template <typename T, class... Args>
-static std::shared_ptr<T> nodeAllocate(Args&&... args)
+static void freeSlab(void* slab)
 {
-    return std::allocate_shared<T>(nodeAllocator<T>(), std::forward<Args>(args)...);
+    if (g_memfileSize > 0) {
+        std::lock_guard<std::mutex> lock(memfileMutex);
+        // the segment manager sits at the start of the mapped segment
+        auto manager = segmentManager();
+        auto begin = reinterpret_cast<const char*>(manager);
+        auto ptr = static_cast<const char*>(slab);
+        if (ptr >= begin && ptr < begin + manager->get_size()) {
+            manager->deallocate(slab);
+            return;
+        }
+    }
+    ::operator delete(slab);
 }
 
-template <typename T, class... Args>
-static std::shared_ptr<T> allocateShared(Args&&... args)
+template <typename TKey, typename TData>
+constexpr typename CPrefixTrie<TKey, TData>::TIndex CPrefixTrie<TKey, TData>::slabBits;
+
+template <typename TKey, typename TData>
+constexpr typename CPrefixTrie<TKey, TData>::TIndex CPrefixTrie<TKey, TData>::slabSize;
+
+template <typename TKey, typename TData>
+constexpr typename CPrefixTrie<TKey, TData>::TIndex CPrefixTrie<TKey, TData>::rootIndex;
+
+template <typename TKey, typename TData>
+typename CPrefixTrie<TKey, TData>::Node& CPrefixTrie<TKey, TData>::node(TIndex index)
 {
-    static auto allocate = g_memfileSize ? nodeAllocate<T, Args...> : std::make_shared<T, Args...>;
-    try {
-        return allocate(std::forward<Args>(args)...);
-    }
-    catch (const bip::bad_alloc&) {
-        allocate = std::make_shared<T, Args...>; // in case we fill up the memfile
-        LogPrint(BCLog::BENCH, "WARNING: The memfile is full; reverting to the RAM allocator for %s.\n", typeid(T).name());
-        return allocate(std::forward<Args>(args)...);
+    return slabs[index >> slabBits][index & (slabSize - 1)];
+}
+
+template <typename TKey, typename TData>
+const typename CPrefixTrie<TKey, TData>::Node& CPrefixTrie<TKey, TData>::node(TIndex index) const
+{
+    return slabs[index >> slabBits][index & (slabSize - 1)];
+}
+
+template <typename TKey, typename TData>
+bool CPrefixTrie<TKey, TData>::valid(TIndex index, TIndex generation) const
+{
+    return index < constructed && node(index).generation == generation;
+}
+
+template <typename TKey, typename TData>
+typename CPrefixTrie<TKey, TData>::TIndex CPrefixTrie<TKey, TData>::allocate()
+{
+    if (!released.empty()) {
+        auto index = released.back();
+        released.pop_back();
+        return index;
     }
+    assert(constructed < std::numeric_limits<TIndex>::max());
+    // slab memory is raw, nodes are constructed as the high water mark moves through it
+    if ((constructed >> slabBits) == slabs.size())
+        slabs.push_back(static_cast<Node*>(allocateSlab(sizeof(Node) * slabSize)));
+    auto index = constructed++;
+    new (&node(index)) Node();
+    return index;
+}
+
+template <typename TKey, typename TData>
+void CPrefixTrie<TKey, TData>::release(TIndex index)
+{
+    auto& n = node(index);
+    n.children.clear();
+    n.data = TData();
+    ++n.generation;
+    released.push_back(index);
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
-CPrefixTrie<TKey, TData>::Iterator<IsConst>::Iterator(const TKey& name, const std::shared_ptr<Node>& node) noexcept : name(name), node(node)
+CPrefixTrie<TKey, TData>::Iterator<IsConst>::Iterator(const TKey& name, TTrie* trie, TIndex node) noexcept : name(name), trie(trie), node(node)
 {
+    generation = trie->node(node).generation;
+}
+
+template <typename TKey, typename TData>
+template <bool IsConst>
+void CPrefixTrie<TKey, TData>::Iterator<IsConst>::moveTo(TIndex index)
+{
+    node = index;
+    generation = trie->node(index).generation;
 }
 
 template <typename TKey, typename TData>
@@ -87,7 +158,9 @@ template <bool C>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator=(const CPrefixTrie<TKey, TData>::Iterator<C>& o) noexcept
 {
     name = o.name;
+    trie = o.trie;
     node = o.node;
+    generation = o.generation;
     stack.clear();
     stack.reserve(o.stack.size());
     for (auto& i : o.stack)
@@ -99,9 +172,8 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::hasNext() const
 {
-    auto shared = node.lock();
-    if (!shared) return false;
-    if (!shared->children.empty()) return true;
+    if (!*this) return false;
+    if (!trie->node(node).children.empty()) return true;
     for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
         auto mark = *it; // copy
         if (++mark.it != mark.end)
@@ -114,20 +186,27 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator++()
 {
-    auto shared = node.lock();
-    assert(shared);
+    assert(*this);
     // going in pre-order (NLR). See https://en.wikipedia.org/wiki/Tree_traversal
     // if there are any children we have to go there first
-    if (!shared->children.empty()) {
-        auto& children = shared->children;
+    auto& children = trie->node(node).children;
+    if (!children.empty()) {
         auto it = children.begin();
         stack.emplace_back(Bookmark{name, it, children.end()});
         auto& postfix = it->first;
         name.insert(name.end(), postfix.begin(), postfix.end());
-        node = it->second;
+        moveTo(it->second);
         return *this;
     }
 
+    skipChildren();
+    return *this;
+}
+
+template <typename TKey, typename TData>
+template <bool IsConst>
+void CPrefixTrie<TKey, TData>::Iterator<IsConst>::skipChildren()
+{
     // move to next sibling:
     while (!stack.empty()) {
         auto& back = stack.back();
@@ -135,16 +214,15 @@ typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>& CPrefixTrie<TKey,
             name = back.name;
             auto& postfix = back.it->first;
             name.insert(name.end(), postfix.begin(), postfix.end());
-            node = back.it->second;
-            return *this;
+            moveTo(back.it->second);
+            return;
         }
         stack.pop_back();
     }
 
     // must be at the end:
-    node.reset();
+    trie = nullptr;
     name = TKey();
-    return *this;
 }
 
 template <typename TKey, typename TData>
@@ -160,14 +238,17 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator bool() const
 {
-    return !node.expired();
+    return trie && trie->valid(node, generation);
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::operator==(const Iterator& o) const
 {
-    return node.lock() == o.node.lock();
+    const bool valid = *this;
+    if (valid != bool(o))
+        return false;
+    return !valid || (trie == o.trie && node == o.node);
 }
 
 template <typename TKey, typename TData>
@@ -216,18 +297,16 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>::data_reference CPrefixTrie<TKey, TData>::Iterator<IsConst>::data()
 {
-    auto shared = node.lock();
-    assert(shared);
-    return *(shared->data);
+    assert(*this);
+    return trie->node(node).data;
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
 const TData& CPrefixTrie<TKey, TData>::Iterator<IsConst>::data() const
 {
-    auto shared = node.lock();
-    assert(shared);
-    return *(shared->data);
+    assert(*this);
+    return trie->node(node).data;
 }
 
 template <typename TKey, typename TData>
@@ -241,145 +320,158 @@ template <typename TKey, typename TData>
 template <bool IsConst>
 bool CPrefixTrie<TKey, TData>::Iterator<IsConst>::hasChildren() const
 {
-    auto shared = node.lock();
-    return shared && !shared->children.empty();
+    return *this && !trie->node(node).children.empty();
 }
 
 template <typename TKey, typename TData>
 template <bool IsConst>
 std::vector<typename CPrefixTrie<TKey, TData>::template Iterator<IsConst>> CPrefixTrie<TKey, TData>::Iterator<IsConst>::children() const
 {
-    auto shared = node.lock();
-    if (!shared) return {};
+    if (!*this) return {};
+    auto& children = trie->node(node).children;
     std::vector<Iterator<IsConst>> ret;
-    ret.reserve(shared->children.size());
-    for (auto& child : shared->children) {
+    ret.reserve(children.size());
+    for (auto& child : children) {
         auto key = name;
         key.insert(key.end(), child.first.begin(), child.first.end());
-        ret.emplace_back(key, child.second);
+        ret.emplace_back(key, trie, child.second);
     }
     return ret;
 }
 
 template <typename TKey, typename TData>
-template <typename TIterator, typename TNode>
-TIterator CPrefixTrie<TKey, TData>::find(const TKey& key, TNode node, TIterator end)
+template <typename TIterator, typename TTrie>
+TIterator CPrefixTrie<TKey, TData>::find(const TKey& key, TTrie* trie, TIndex node, TIterator end)
 {
-    TIterator it(key, TNode());
-    using CBType = callback<TNode>;
-    CBType cb = [&it](const TKey&, TNode node) {
-        it.node = node;
+    auto found = node;
+    auto cb = [&found](const TKey&, TIndex node) {
+        found = node;
     };
-    return find(key, node, cb) ? it : end;
-}
-
-template <typename TKey, typename TData>
-template <typename TNode>
-bool CPrefixTrie<TKey, TData>::find(const TKey& key, TNode node, const callback<TNode>& cb)
-{
-    auto& children = node->children;
-    if (children.empty()) return false;
-    auto it = children.lower_bound(key);
-    if (it != children.end() && it->first == key) {
-        cb(key, it->second);
-        return true;
+    return trie->walk(key, node, cb) ? TIterator(key, trie, found) : end;
+}
+
+template <typename TKey, typename TData>
+template <typename TCallback>
+bool CPrefixTrie<TKey, TData>::walk(const TKey& key, TIndex current, TCallback&& cb) const
+{
+    // edges are labeled with the whole compressed run of the key, and no two siblings
+    // start with the same element; so there is at most one candidate edge per level
+    // and we can walk down by offset without copying what is left of the key
+    auto kit = key.begin();
+    const auto kend = key.end();
+    while (kit != kend) {
+        auto& children = node(current).children;
+        auto it = children.lower_bound(TKey(1, *kit));
+        if (it == children.end())
+            return false;
+        auto& label = it->first;
+        if (std::size_t(kend - kit) < label.size() || !std::equal(label.begin(), label.end(), kit))
+            return false;
+        kit += label.size();
+        current = it->second;
+        cb(label, current);
     }
-    if (it != children.begin()) --it;
-    const auto count = match(key, it->first);
-    if (count != it->first.size()) return false;
-    if (count == key.size()) return false;
-    cb(it->first, it->second);
-    return find(TKey(key.begin() + count, key.end()), it->second, cb);
+    return true;
 }
 
 template <typename TKey, typename TData>
-template <typename TIterator, typename TNode>
-std::vector<TIterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key, TNode root)
+template <typename TIterator, typename TTrie>
+std::vector<TIterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key, TTrie* trie)
 {
     std::vector<TIterator> ret;
     ret.reserve(1 + key.size());
-    ret.emplace_back(TKey{}, root);
+    ret.emplace_back(TKey{}, trie, rootIndex);
     if (key.empty()) return ret;
-    TKey name;
-    using CBType = callback<TNode>;
-    CBType cb = [&name, &ret](const TKey& key, TNode node) {
-        name.insert(name.end(), key.begin(), key.end());
-        ret.emplace_back(name, node);
+    std::size_t length = 0;
+    auto cb = [&key, &length, &ret, trie](const TKey& label, TIndex node) {
+        length += label.size();
+        ret.emplace_back(TKey(key.begin(), key.begin() + length), trie, node);
     };
-    find(key, root, cb);
+    trie->walk(key, rootIndex, cb);
     return ret;
 }
 
 template <typename TKey, typename TData>
-std::shared_ptr<typename CPrefixTrie<TKey, TData>::Node>& CPrefixTrie<TKey, TData>::insert(const TKey& key, std::shared_ptr<typename CPrefixTrie<TKey, TData>::Node>& node)
+typename CPrefixTrie<TKey, TData>::TIndex CPrefixTrie<TKey, TData>::insert(const TKey& key, TIndex current)
 {
-    std::size_t count = 0;
-    auto& children = node->children;
-    auto it = children.lower_bound(key);
-    if (it != children.end()) {
-        if (it->first == key)
-            return it->second;
-        count = match(key, it->first);
-    }
-    if (count == 0 && it != children.begin()) {
-        --it;
-        count = match(key, it->first);
-    }
-    if (count == 0) {
-        ++size;
-        it = children.emplace(key, allocateShared<Node>()).first;
-        return it->second;
-    }
-    if (count < it->first.size()) {
-        TKey prefix(key.begin(), key.begin() + count);
-        TKey postfix(it->first.begin() + count, it->first.end());
-        auto nodes = std::move(it->second);
-        children.erase(it);
-        ++size;
-        it = children.emplace(std::move(prefix), allocateShared<Node>()).first;
-        it->second->children.emplace(std::move(postfix), std::move(nodes));
-        if (key.size() == count)
+    auto kit = key.begin();
+    const auto kend = key.end();
+    while (true) {
+        auto& children = node(current).children;
+        auto it = children.lower_bound(TKey(1, *kit));
+        std::size_t count = 0;
+        if (it != children.end()) {
+            auto& label = it->first;
+            auto lit = label.begin();
+            for (auto k = kit; k != kend && lit != label.end() && *k == *lit; ++k, ++lit)
+                ++count;
+        }
+        if (count == 0) {
+            ++size;
+            auto index = allocate();
+            children.emplace(TKey(kit, kend), index);
+            return index;
+        }
+        const bool consumed = std::size_t(kend - kit) == count;
+        if (count < it->first.size()) {
+            // split the edge: the common run becomes a new (empty) node
+            TKey prefix(kit, kit + count);
+            TKey postfix(it->first.begin() + count, it->first.end());
+            auto nodes = it->second;
+            children.erase(it);
+            ++size;
+            auto index = allocate();
+            children.emplace(std::move(prefix), index);
+            node(index).children.emplace(std::move(postfix), nodes);
+            if (consumed)
+                return index;
+            current = index;
+        } else if (consumed) {
             return it->second;
-        it->second->data = allocateShared<TData>();
+        } else {
+            current = it->second;
+        }
+        kit += count;
     }
-    return insert(TKey(key.begin() + count, key.end()), it->second);
 }
 
 template <typename TKey, typename TData>
-void CPrefixTrie<TKey, TData>::erase(const TKey& key, std::shared_ptr<Node>& node)
+void CPrefixTrie<TKey, TData>::erase(const TKey& key, TIndex current)
 {
-    std::vector<typename TChildren::value_type> nodes;
-    nodes.emplace_back(TKey(), node);
-    using CBType = callback<std::shared_ptr<Node>>;
-    CBType cb = [&nodes](const TKey& k, std::shared_ptr<Node> n) {
+    std::vector<std::pair<TKey, TIndex>> nodes;
+    nodes.emplace_back(TKey(), current);
+    auto cb = [&nodes](const TKey& k, TIndex n) {
         nodes.emplace_back(k, n);
     };
-    if (!find(key, node, cb))
+    if (!walk(key, current, cb))
         return;
 
-    nodes.back().second->data = allocateShared<TData>();
+    node(nodes.back().second).data = TData();
     for (; nodes.size() > 1; nodes.pop_back()) {
         // if we have only one child and no data ourselves, bring them up to our level
-        auto& cNode = nodes.back().second;
-        auto onlyOneChild = cNode->children.size() == 1;
-        auto noData = cNode->data->empty();
+        auto index = nodes.back().second;
+        auto& cNode = node(index);
+        auto onlyOneChild = cNode.children.size() == 1;
+        auto noData = cNode.data.empty();
         if (onlyOneChild && noData) {
-            auto child = cNode->children.begin();
+            auto child = cNode.children.begin();
             auto& prefix = nodes.back().first;
             auto newKey = prefix;
             auto& postfix = child->first;
             newKey.insert(newKey.end(), postfix.begin(), postfix.end());
-            auto& pNode = nodes[nodes.size() - 2].second;
-            pNode->children.emplace(std::move(newKey), std::move(child->second));
-            pNode->children.erase(prefix);
+            auto& pNode = node(nodes[nodes.size() - 2].second);
+            pNode.children.emplace(std::move(newKey), child->second);
+            pNode.children.erase(prefix);
+            release(index);
             --size;
             continue;
         }
 
-        auto noChildren = cNode->children.empty();
+        auto noChildren = cNode.children.empty();
         if (noChildren && noData) {
-            auto& pNode = nodes[nodes.size() - 2].second;
-            pNode->children.erase(nodes.back().first);
+            auto& pNode = node(nodes[nodes.size() - 2].second);
+            pNode.children.erase(nodes.back().first);
+            release(index);
             --size;
             continue;
         }
@@ -388,43 +480,52 @@ void CPrefixTrie<TKey, TData>::erase(const TKey& key, std::shared_ptr<Node>& nod
 }
 
 template <typename TKey, typename TData>
-CPrefixTrie<TKey, TData>::CPrefixTrie() : size(0), root(allocateShared<Node>())
+CPrefixTrie<TKey, TData>::CPrefixTrie() : size(0), constructed(0)
 {
-    root->data = allocateShared<TData>();
+    auto root = allocate();
+    assert(root == rootIndex);
+}
+
+template <typename TKey, typename TData>
+CPrefixTrie<TKey, TData>::~CPrefixTrie()
+{
+    for (TIndex i = 0; i < constructed; ++i)
+        node(i).~Node();
+    for (auto slab : slabs)
+        freeSlab(slab);
 }
 
 template <typename TKey, typename TData>
 template <typename TDataUni>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::insert(const TKey& key, TDataUni&& data)
 {
-    auto& node = key.empty() ? root : insert(key, root);
-    node->data = allocateShared<TData>(std::forward<TDataUni>(data));
-    return key.empty() ? begin() : iterator{key, node};
+    auto index = key.empty() ? rootIndex : insert(key, rootIndex);
+    node(index).data = std::forward<TDataUni>(data);
+    return key.empty() ? begin() : iterator{key, this, index};
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::copy(CPrefixTrie<TKey, TData>::const_iterator it)
 {
     auto& key = it.key();
-    auto& node = key.empty() ? root : insert(key, root);
-    node->data = it.node.lock()->data;
-    return key.empty() ? begin() : iterator{key, node};
+    auto index = key.empty() ? rootIndex : insert(key, rootIndex);
+    node(index).data = it.data();
+    return key.empty() ? begin() : iterator{key, this, index};
 }
 
 template <typename TKey, typename TData>
 template <typename TDataUni>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::insert(CPrefixTrie<TKey, TData>::iterator& it, const TKey& key, TDataUni&& data)
 {
-    auto shared = it.node.lock();
-    assert(shared);
+    assert(it && it.trie == this);
     auto copy = it;
     if (!key.empty()) {
         auto name = it.key();
         name.insert(name.end(), key.begin(), key.end());
-        auto& node = insert(key, shared);
-        copy = iterator{std::move(name), node};
+        auto index = insert(key, it.node);
+        copy = iterator{std::move(name), this, index};
     }
-    copy.node.lock()->data = allocateShared<TData>(std::forward<TDataUni>(data));
+    node(copy.node).data = std::forward<TDataUni>(data);
     return copy;
 }
 
@@ -432,34 +533,77 @@ template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::find(const TKey& key)
 {
     if (empty()) return end();
-    if (key.empty()) return {key, root};
-    return find(key, root, end());
+    if (key.empty()) return {key, this, rootIndex};
+    return find(key, this, rootIndex, end());
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::const_iterator CPrefixTrie<TKey, TData>::find(const TKey& key) const
 {
     if (empty()) return end();
-    if (key.empty()) return {key, root};
-    return find(key, root, end());
+    if (key.empty()) return {key, this, rootIndex};
+    return find(key, this, rootIndex, end());
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::find(CPrefixTrie<TKey, TData>::iterator& it, const TKey& key)
 {
     if (key.empty()) return it;
-    auto shared = it.node.lock();
-    assert(shared);
-    return find(key, shared, end());
+    assert(it && it.trie == this);
+    return find(key, this, it.node, end());
 }
 
 template <typename TKey, typename TData>
 typename CPrefixTrie<TKey, TData>::const_iterator CPrefixTrie<TKey, TData>::find(CPrefixTrie<TKey, TData>::const_iterator& it, const TKey& key) const
 {
     if (key.empty()) return it;
-    auto shared = it.node.lock();
-    assert(shared);
-    return find(key, shared, end());
+    assert(it && it.trie == this);
+    return find(key, this, it.node, end());
+}
+
+template <typename TKey, typename TData>
+template <typename TIterator, typename TTrie>
+TIterator CPrefixTrie<TKey, TData>::lowerBound(const TKey& key, TTrie* trie)
+{
+    // iterating goes in key order as no two siblings start with the same element,
+    // so walk down as find does and stop at the first edge that leaves the key
+    TIterator it(TKey(), trie, rootIndex);
+    std::size_t pos = 0;
+    while (pos < key.size()) {
+        auto& children = trie->node(it.node).children;
+        auto child = children.lower_bound(TKey(1, key[pos]));
+        if (child == children.end()) {
+            // all of this node's children sort before the key
+            it.skipChildren();
+            return it;
+        }
+        auto& label = child->first;
+        it.stack.push_back({it.name, child, children.end()});
+        it.name.insert(it.name.end(), label.begin(), label.end());
+        it.moveTo(child->second);
+        auto length = std::min(label.size(), key.size() - pos);
+        auto cmp = label.compare(0, length, key, pos, length);
+        if (cmp < 0) {
+            it.skipChildren();
+            return it;
+        }
+        if (cmp > 0 || label.size() > length)
+            return it;
+        pos += length;
+    }
+    return it;
+}
+
+template <typename TKey, typename TData>
+typename CPrefixTrie<TKey, TData>::iterator CPrefixTrie<TKey, TData>::lower_bound(const TKey& key)
+{
+    return lowerBound<iterator>(key, this);
+}
+
+template <typename TKey, typename TData>
+typename CPrefixTrie<TKey, TData>::const_iterator CPrefixTrie<TKey, TData>::lower_bound(const TKey& key) const
+{
+    return lowerBound<const_iterator>(key, this);
 }
 
 template <typename TKey, typename TData>
@@ -478,14 +622,14 @@ template <typename TKey, typename TData>
 std::vector<typename CPrefixTrie<TKey, TData>::iterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key)
 {
     if (empty()) return {};
-    return nodes<iterator>(key, root);
+    return nodes<iterator>(key, this);
 }
 
 template <typename TKey, typename TData>
 std::vector<typename CPrefixTrie<TKey, TData>::const_iterator> CPrefixTrie<TKey, TData>::nodes(const TKey& key) const
 {
     if (empty()) return {};
-    return nodes<const_iterator>(key, root);
+    return nodes<const_iterator>(key, this);
 }
 
 template <typename TKey, typename TData>
@@ -493,9 +637,9 @@ bool CPrefixTrie<TKey, TData>::erase(const TKey& key)
 {
     auto size_was = height();
     if (key.empty()) {
-        root->data = allocateShared<TData>();
+        node(rootIndex).data = TData();
     } else {
-        erase(key, root);
+        erase(key, rootIndex);
     }
     return size_was != height();
 }
@@ -503,9 +647,19 @@ bool CPrefixTrie<TKey, TData>::erase(const TKey& key)
 template <typename TKey, typename TData>
 void CPrefixTrie<TKey, TData>::clear()
 {
+    std::vector<TIndex> pending;
+    for (auto& child : node(rootIndex).children)
+        pending.push_back(child.second);
+    while (!pending.empty()) {
+        auto index = pending.back();
+        pending.pop_back();
+        for (auto& child : node(index).children)
+            pending.push_back(child.second);
+        release(index);
+    }
     size = 0;
-    root->data = allocateShared<TData>();
-    root->children.clear();
+    node(rootIndex).data = TData();
+    node(rootIndex).children.clear();
 }
 
 template <typename TKey, typename TData>
@@ -517,7 +671,7 @@ bool CPrefixTrie<TKey, TData>::empty() const
 template <typename TKey, typename TData>
 std::size_t CPrefixTrie<TKey, TData>::height() const
 {
-    return size + (root->data->empty() ? 0 : 1);
+    return size + (node(rootIndex).data.empty() ? 0 : 1);
 }
 
 template <typename TKey, typename TData>
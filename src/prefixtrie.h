@@ -2,6 +2,7 @@
 #define BITCOIN_PREFIXTRIE_H
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
@@ -16,12 +17,21 @@ namespace bc = boost::container;
 template <typename TKey, typename TData>
 class CPrefixTrie
 {
+    // nodes live in fixed size slabs owned by the trie and are addressed by a 32-bit index;
+    // slabs never move, so neither do the nodes (nor their data) while they are in use
+    using TIndex = uint32_t;
+    static constexpr TIndex slabBits = 12;
+    static constexpr TIndex slabSize = TIndex(1) << slabBits;
+    static constexpr TIndex rootIndex = 0;
+
     class Node
     {
         template <bool>
         friend class Iterator;
         friend class CPrefixTrie<TKey, TData>;
-        bc::flat_map<TKey, std::shared_ptr<Node>> children;
+        bc::flat_map<TKey, TIndex> children;
+        // bumped each time the node is released so that stale iterators can tell
+        TIndex generation = 0;
 
     public:
         Node() = default;
@@ -29,11 +39,15 @@ class CPrefixTrie
         Node(Node&& o) noexcept = default;
         Node& operator=(Node&&) noexcept = default;
         Node& operator=(const Node&) = delete;
-        std::shared_ptr<TData> data;
+        TData data;
     };
 
     using TChildren = decltype(Node::children);
 
+    // the node is reached by index and generation, but the iterator isn't trivially copyable: key() hands
+    // out a reference and nodes only know their part of the key, and as nodes have no parent link ++ and
+    // depth() walk the stack of positions among the parents' children. Keeping those in the nodes instead
+    // would cost every node of the trie the memory that only the iterators alive at a time pay now.
     template <bool IsConst>
     class Iterator
     {
@@ -45,18 +59,25 @@ class CPrefixTrie
         using TDataRef = std::reference_wrapper<typename std::conditional<IsConst, const TData, TData>::type>;
         using TPair = std::pair<TKeyRef, TDataRef>;
         using ConstTPair = std::pair<TKeyRef, const TData>;
+        using TTrie = typename std::conditional<IsConst, const CPrefixTrie<TKey, TData>, CPrefixTrie<TKey, TData>>::type;
 
         TKey name;
-        std::weak_ptr<Node> node;
+        TTrie* trie = nullptr;
+        TIndex node = 0;
+        TIndex generation = 0;
 
         struct Bookmark {
             TKey name;
-            typename TChildren::iterator it;
-            typename TChildren::iterator end;
+            typename TChildren::const_iterator it;
+            typename TChildren::const_iterator end;
         };
 
         std::vector<Bookmark> stack;
 
+        void moveTo(TIndex index);
+        // move on to whatever comes after this node's children, the next sibling of it or of a parent
+        void skipChildren();
+
     public:
         // Iterator traits
         using value_type = TPair;
@@ -71,7 +92,7 @@ class CPrefixTrie
         Iterator() = default;
         Iterator(const Iterator&) = default;
         Iterator(Iterator&& o) noexcept = default;
-        Iterator(const TKey& name, const std::shared_ptr<Node>& node) noexcept;
+        Iterator(const TKey& name, TTrie* trie, TIndex node) noexcept;
         template <bool C>
         inline Iterator(const Iterator<C>& o) noexcept
         {
@@ -110,28 +131,43 @@ class CPrefixTrie
     };
 
     size_t size;
-    std::shared_ptr<Node> root;
+    std::vector<Node*> slabs;
+    std::vector<TIndex> released;
+    TIndex constructed;
+
+    Node& node(TIndex index);
+    const Node& node(TIndex index) const;
+    bool valid(TIndex index, TIndex generation) const;
 
-    template <typename TNode>
-    using callback = std::function<void(const TKey&, TNode)>;
+    TIndex allocate();
+    void release(TIndex index);
 
-    template <typename TIterator, typename TNode>
-    static TIterator find(const TKey& key, TNode node, TIterator end);
+    template <typename TIterator, typename TTrie>
+    static TIterator find(const TKey& key, TTrie* trie, TIndex node, TIterator end);
 
-    template <typename TNode>
-    static bool find(const TKey& key, TNode node, const callback<TNode>& cb);
+    template <typename TCallback>
+    bool walk(const TKey& key, TIndex node, TCallback&& cb) const;
 
-    template <typename TIterator, typename TNode>
-    static std::vector<TIterator> nodes(const TKey& key, TNode root);
+    template <typename TIterator, typename TTrie>
+    static std::vector<TIterator> nodes(const TKey& key, TTrie* trie);
 
-    std::shared_ptr<Node>& insert(const TKey& key, std::shared_ptr<Node>& node);
-    void erase(const TKey& key, std::shared_ptr<Node>& node);
+    template <typename TIterator, typename TTrie>
+    static TIterator lowerBound(const TKey& key, TTrie* trie);
+
+    TIndex insert(const TKey& key, TIndex node);
+    void erase(const TKey& key, TIndex node);
 
 public:
     using iterator = Iterator<false>;
     using const_iterator = Iterator<true>;
 
     CPrefixTrie();
+    ~CPrefixTrie();
+
+    CPrefixTrie(CPrefixTrie&&) = delete;
+    CPrefixTrie(const CPrefixTrie&) = delete;
+    CPrefixTrie& operator=(CPrefixTrie&&) = delete;
+    CPrefixTrie& operator=(const CPrefixTrie&) = delete;
 
     template <typename TDataUni>
     iterator insert(const TKey& key, TDataUni&& data);
@@ -147,6 +183,10 @@ public:
 
     bool contains(const TKey& key) const;
 
+    // first node, in the order the iterators go, whose key does not sort before key
+    iterator lower_bound(const TKey& key);
+    const_iterator lower_bound(const TKey& key) const;
+
     TData& at(const TKey& key);
 
     std::vector<iterator> nodes(const TKey& key);
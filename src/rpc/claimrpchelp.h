@@ -46,6 +46,14 @@
 #define T_SUPPORTSREMOVED               "supportsRemoved"
 #define T_ADDRESS                       "address"
 #define T_PENDINGAMOUNT                 "pendingAmount"
+#define T_FILENAME                      "filename"
+#define T_ENTRIES                       "entries"
+#define T_START                         "start"
+#define T_LIMIT                         "limit"
+#define T_EVENT                         "event"
+#define T_STARTHEIGHT                   "startHeight"
+#define T_ENDHEIGHT                     "endHeight"
+#define T_EXPIRATIONHEIGHT              "expirationHeight"
 
 enum {
     GETCLAIMSINTRIE = 0,
@@ -64,6 +72,12 @@ enum {
     GETCLAIMPROOFBYBID,
     GETCLAIMPROOFBYSEQ,
     GETCHANGESINBLOCK,
+    DUMPCLAIMTRIE,
+    RESOLVENAMES,
+    GETCLAIMHISTORY,
+    GETSUPPORTSBYCLAIMID,
+    GETTOPCLAIMS,
+    GETEXPIRINGCLAIMS,
 };
 
 #define S3_(pre, name, def) pre "\"" name "\"" def "\n"
@@ -78,6 +92,12 @@ enum {
 "                                                  the latest active\n" \
 "                                                  block will be used."
 
+#define PAGE_ARGS \
+S3("2. ", T_START, "                   (string, optional) only return names that come after this one\n" \
+"                                                  in trie order, pass the last name of a page\n" \
+"                                                  to get the next one") \
+S3("3. ", T_LIMIT, "                   (numeric, optional) return no more than this many names")
+
 #define CLAIM_OUTPUT    \
 S3("    ", T_NORMALIZEDNAME, "         (string) the name of the claim (after normalization)") \
 S3("    ", T_NAME, "                   (string) the original name of this claim (before normalization)") \
@@ -128,10 +148,11 @@ S3("    ", T_LASTTAKEOVERHEIGHT, "     (numeric) the last height at which owners
 static const char* const rpc_help[] = {
 
 // GETCLAIMSINTRIE
-S1("getclaimsintrie ( \"" T_BLOCKHASH R"(" )
+S1("getclaimsintrie ( \"" T_BLOCKHASH "\" \"" T_START "\" " T_LIMIT R"( )
 Return all claims in the name trie. Deprecated
 Arguments:)")
 S3("1. ", T_BLOCKHASH, BLOCKHASH_TEXT)
+PAGE_ARGS
 S1("Result: [")
 S3("    ", T_NORMALIZEDNAME, "         (string) the name of the claim(s) (after normalization)")
 S3("    ", T_CLAIMS, ": [              (array of object) the claims for this name")
@@ -148,10 +169,11 @@ S1("    ]")
 "]",
 
 // GETNAMESINTRIE
-S1("getnamesintrie ( \"" T_BLOCKHASH R"(" )
+S1("getnamesintrie ( \"" T_BLOCKHASH "\" \"" T_START "\" " T_LIMIT R"( )
 Return all claim names in the trie.
 Arguments:)")
 S3("1. ", T_BLOCKHASH, BLOCKHASH_TEXT)
+PAGE_ARGS
 S1("Result: [")
 S3("    ", T_NAMES, "                  all names in the trie that have claims")
 "]",
@@ -340,6 +362,115 @@ S3("    ", T_SUPPORTSADDEDORUPDATED, " (array of string) IDs of supports added o
 S3("    ", T_SUPPORTSREMOVED, "        (array of string) IDs that were removed from the trie")
 "]",
 
+// DUMPCLAIMTRIE
+S1("dumpclaimtrie \"" T_FILENAME R"("
+Write the claim trie at the current tip to a snapshot file, another node at the same tip can start from it with -loadclaimtrie.
+Arguments:)")
+S3("1. ", T_FILENAME, "                (string) the file to write, it must not exist yet")
+S1("Result: {")
+S3("    ", T_FILENAME, "               (string) the full path of the written file")
+S3("    ", T_HEIGHT, "                 (numeric) the height of the block the snapshot was taken at")
+S3("    ", T_BLOCKHASH, "              (string) the hash of that block")
+S3("    ", T_ENTRIES, "                (numeric) the number of database entries written")
+"}",
+
+// RESOLVENAMES
+S1("resolvenames [\"" T_NAME "\" | {\"" T_NAME "\": ..., \"" T_CLAIMID "\": ...}, ...] ( \"" T_BLOCKHASH R"(" )
+Return what getvalueforname returns for each of the names, all looked up at the same block
+Arguments:)")
+S3("1. ", T_NAMES, "                   (array) the names to look up, either as strings or as objects\n"
+"                                                  with a " T_NAME " and an optional, possibly partial, " T_CLAIMID)
+S3("2. ", T_BLOCKHASH, BLOCKHASH_TEXT)
+S1("Result: [                                      (array of object) in the order of the names, empty if there is no such claim")
+S1("  {")
+CLAIM_OUTPUT
+S1("  }")
+"]",
+
+// GETCLAIMHISTORY
+S1("getclaimhistory \"" T_CLAIMID "\" ( " T_START " " T_LIMIT R"( )
+Return the claim, its updates, its supports and their abandons in block order, requires -claimhistoryindex
+Arguments:)")
+S3("1. ", T_CLAIMID, "                (string) the full claimId")
+S3("2. ", T_START, "                   (numeric, optional) only return events from this height on, pass the\n"
+"                                                  height after the last event of a page to get the next one")
+S3("3. ", T_LIMIT, "                   (numeric, optional) return about this many events, the events of the\n"
+"                                                  last block are all returned even when there are more")
+S1("Result: [")
+S1("  {")
+S3("    ", T_EVENT, "                  (string) claim, update, abandon, support or abandonsupport")
+S3("    ", T_NAME, "                   (string) the name in the claim or support script")
+S3("    ", T_VALUE, "                  (string) the value of the claim or the metadata of the support if any")
+S3("    ", T_TXID, "                   (string) the txid of the output, for an abandon the one spent")
+S3("    ", T_N, "                      (numeric) the index of the output in the transaction's list of outputs")
+S3("    ", T_AMOUNT, "                 (numeric) the amount of the output")
+S3("    ", T_HEIGHT, "                 (numeric) the height of the block the event is in")
+S3("    ", T_BLOCKHASH, "              (string) the hash of that block")
+S1("  }")
+"]",
+
+// GETSUPPORTSBYCLAIMID
+S1("getsupportsbyclaimid \"" T_CLAIMID "\"" R"(
+Return the active supports of a claim, whichever names they are under, without going through the supports of the name
+Arguments:)")
+S3("1. ", T_CLAIMID, "                (string) the full claimId")
+S1("Result: [")
+S1("  {")
+S3("    ", T_NAME, "                   (string) the name the support is under (after normalization)")
+S3("    ", T_VALUE, "                  (string) the metadata of the support if any")
+S3("    ", T_ADDRESS, "                (string) the destination address of the support")
+S3("    ", T_TXID, "                   (string) the txid of the support")
+S3("    ", T_N, "                      (numeric) the index of the support in the transaction's list of outputs")
+S3("    ", T_HEIGHT, "                 (numeric) the height of the block in which this transaction is located")
+S3("    ", T_VALIDATHEIGHT, "          (numeric) the height at which the support became valid")
+S3("    ", T_AMOUNT, "                 (numeric) the amount of the support")
+S1("  }")
+"]",
+
+// GETTOPCLAIMS
+S1("gettopclaims ( " T_START " " T_LIMIT R"( )
+Return the controlling claims with the highest effective amounts, without going through the whole trie, requires -claimtrieranking
+Arguments:)")
+S3("1. ", T_START, "                   (numeric, optional) skip this many claims, pass the number of claims\n"
+"                                                  returned so far to get the next page")
+S3("2. ", T_LIMIT, "                   (numeric, optional) return no more than this many claims")
+S1("Result: [                                      (array of object) by effective amount, highest first")
+S1("  {")
+S3("    ", T_NORMALIZEDNAME, "         (string) the name of the claim (after normalization)")
+S3("    ", T_NAME, "                   (string) the original name of this claim (before normalization)")
+S3("    ", T_VALUE, "                  (string) the value of this claim")
+S3("    ", T_ADDRESS, "                (string) the destination address of this claim")
+S3("    ", T_CLAIMID, "                (string) the claimId of the claim")
+S3("    ", T_TXID, "                   (string) the txid of the claim")
+S3("    ", T_N, "                      (numeric) the index of the claim in the transaction's list of outputs")
+S3("    ", T_HEIGHT, "                 (numeric) the height of the block in which this transaction is located")
+S3("    ", T_VALIDATHEIGHT, "          (numeric) the height at which the claim became valid")
+S3("    ", T_AMOUNT, "                 (numeric) the amount of the claim")
+S3("    ", T_EFFECTIVEAMOUNT, "        (numeric) the amount plus amount from all supports associated with the claim")
+S3("    ", T_LASTTAKEOVERHEIGHT, "     (numeric) the last height at which ownership of the name changed")
+S1("  }")
+"]",
+
+// GETEXPIRINGCLAIMS
+S1("getexpiringclaims " T_STARTHEIGHT " ( " T_ENDHEIGHT R"( )
+Return the claims and supports that expire in the blocks from one height to another, unless they are updated or spent before
+Arguments:)")
+S3("1. ", T_STARTHEIGHT, "             (numeric) the height of the first block")
+S3("2. ", T_ENDHEIGHT, "               (numeric, optional) the height of the last block, the first one if not given;\n"
+"                                                  up to 10000 blocks are looked up at once")
+S1("Result: [                                      (array of object) in the order they expire")
+S1("  {")
+S3("    ", T_CLAIMTYPE, "              (string) claim or support")
+S3("    ", T_NAME, "                   (string) the name of the claim or support")
+S3("    ", T_CLAIMID, "                (string) the claimId of the claim or the one the support is for")
+S3("    ", T_TXID, "                   (string) the txid of the claim or support")
+S3("    ", T_N, "                      (numeric) the index of the output in the transaction's list of outputs")
+S3("    ", T_AMOUNT, "                 (numeric) the amount of the output")
+S3("    ", T_ADDRESS, "                (string) the destination address of the output")
+S3("    ", T_EXPIRATIONHEIGHT, "       (numeric) the height of the block it expires in")
+S1("  }")
+"]",
+
 };
 
 #endif // CLAIMRPCHELP_H
@@ -1,6 +1,8 @@
 #include <claimtrie.h>
 #include <coins.h>
 #include <core_io.h>
+#include <index/claimhistoryindex.h>
+#include <index/claimindex.h>
 #include <key_io.h>
 #include <logging.h>
 #include <nameclaim.h>
@@ -18,6 +20,9 @@
 #include <boost/locale/conversion.hpp>
 #include <boost/thread.hpp>
 #include <cmath>
+#include <limits>
+#include <map>
+#include <set>
 
 static constexpr size_t claimIdHexLength = 40;
 
@@ -52,12 +57,17 @@ static CBlockIndex* BlockHashIndex(const uint256& blockHash)
 }
 
 #define MAX_RPC_BLOCK_DECREMENTS 500
+#define MAX_RPC_EXPIRING_HEIGHTS 10000
 
 extern CChainState g_chainstate;
 void RollBackTo(const CBlockIndex* targetIndex, CCoinsViewCache& coinsCache, CClaimTrieCache& trieCache)
 {
     AssertLockHeld(cs_main);
 
+    // within the -claimtriehistory depth that's a lookup, deeper blocks are still rolled back to
+    if (trieCache.loadHistory(targetIndex))
+        return;
+
     const CBlockIndex* activeIndex = chainActive.Tip();
 
     if (activeIndex->nHeight > (targetIndex->nHeight + MAX_RPC_BLOCK_DECREMENTS))
@@ -84,6 +94,30 @@ void RollBackTo(const CBlockIndex* targetIndex, CCoinsViewCache& coinsCache, CCl
     trieCache.getMerkleHash(); // update the hash tree
 }
 
+/**
+ * Look up the claims for the name in the first parameter at the tip in the published trie snapshot,
+ * without cs_main. Returns null if a block hash is given at nBlockHashParam, see claimsAtBlock.
+ */
+static std::unique_ptr<CClaimsForNameView> claimsAtTip(const JSONRPCRequest& request, std::size_t nBlockHashParam)
+{
+    if (request.params.size() > nBlockHashParam)
+        return nullptr;
+    auto snapshot = pclaimTrie->getSnapshot();
+    return std::unique_ptr<CClaimsForNameView>(new CClaimsForNameView(snapshot->viewClaimsForName(request.params[0].get_str())));
+}
+
+/**
+ * Claims for the name in the first parameter as of the block at nBlockHashParam; coinsCache and trieCache
+ * are rolled back along and the claims must not be used after trieCache is gone.
+ */
+static CClaimsForNameView claimsAtBlock(const JSONRPCRequest& request, std::size_t nBlockHashParam, CCoinsViewCache& coinsCache, CClaimTrieCache& trieCache)
+{
+    AssertLockHeld(cs_main);
+    auto paramName = strprintf(T_BLOCKHASH " (optional parameter %d)", nBlockHashParam + 1);
+    RollBackTo(BlockHashIndex(ParseHashV(request.params[nBlockHashParam], paramName)), coinsCache, trieCache);
+    return trieCache.viewClaimsForName(request.params[0].get_str());
+}
+
 std::string escapeNonUtf8(const std::string& name)
 {
     using namespace boost::locale::conv;
@@ -130,7 +164,7 @@ bool getClaimById(const uint160& claimId, std::string& name, CClaimValue* claim
         return false;
 
     CClaimIndexElement element;
-    if (!pclaimTrie->db->Read(std::make_pair(CLAIM_BY_ID, claimId), element))
+    if (!pclaimTrie->read(std::make_pair(CLAIM_BY_ID, claimId), element))
         return false;
     if (element.claim.claimId == claimId) {
         name = element.name;
@@ -144,21 +178,25 @@ bool getClaimById(const uint160& claimId, std::string& name, CClaimValue* claim
 // name can be setted explicitly
 bool getClaimById(const std::string& partialId, std::string& name, CClaimValue* claim = nullptr)
 {
-    if (partialId.empty())
+    if (partialId.empty() || partialId.length() > claimIdHexLength)
         return false;
 
+    // the ids starting with partialId are next to each other in the hex ordered index
+    auto lowest = uint160S(partialId + std::string(claimIdHexLength - partialId.length(), '0'));
+    pclaimTrie->writePending();
     std::unique_ptr<CDBIterator> pcursor(pclaimTrie->db->NewIterator());
 
-    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+    for (pcursor->Seek(std::make_pair(CLAIM_BY_HEX_ID, hexOrderedClaimId(lowest))); pcursor->Valid(); pcursor->Next()) {
         std::pair<uint8_t, uint160> key;
-        if (!pcursor->GetKey(key) || key.first != CLAIM_BY_ID)
-            continue;
+        uint160 claimId;
+        if (!pcursor->GetKey(key) || key.first != CLAIM_BY_HEX_ID || !pcursor->GetValue(claimId))
+            break;
 
-        if (key.second.GetHex().find(partialId) != 0)
-            continue;
+        if (claimId.GetHex().compare(0, partialId.length(), partialId) != 0)
+            break;
 
         CClaimIndexElement element;
-        if (pcursor->GetValue(element)) {
+        if (pclaimTrie->read(std::make_pair(CLAIM_BY_ID, claimId), element)) {
             if (!name.empty() && name != element.name)
                 continue;
             name = element.name;
@@ -170,26 +208,57 @@ bool getClaimById(const std::string& partialId, std::string& name, CClaimValue*
     return false;
 }
 
-std::vector<CClaimNsupports> seqSort(const std::vector<CClaimNsupports>& source)
+static std::size_t seqOf(const CClaimsForNameView& claims, std::size_t bid)
 {
-    auto claimsNsupports = source;
+    if (claims.size() == 1)
+        return 0;
+    auto seqOrder = claims.seqOrder();
+    return std::distance(seqOrder.begin(), std::find(seqOrder.begin(), seqOrder.end(), bid));
+}
 
-    std::sort(claimsNsupports.begin(), claimsNsupports.end(), [](const CClaimNsupports& lhs, const CClaimNsupports& rhs) {
-        auto& lc = lhs.claim;
-        auto& rc = rhs.claim;
-        return lc.nHeight < rc.nHeight || (lc.nHeight == rc.nHeight && lc.outPoint.n < rc.outPoint.n);
-    });
+static bool getOutput(const CCoinsViewCache& coinsCache, const COutPoint& outPoint, int nHeight, CTxOut& out)
+{
+    auto& coin = coinsCache.AccessCoin(outPoint);
+    if (!coin.IsSpent()) {
+        out = coin.out;
+        return true;
+    }
 
-    return claimsNsupports;
+    // spent since, when looked up from the claim trie history, it is still in its block
+    if (nHeight < 0 || nHeight > chainActive.Height())
+        return false;
+    uint256 hashBlock;
+    CTransactionRef tx;
+    if (!GetTransaction(outPoint.hash, tx, Params().GetConsensus(), hashBlock, false, chainActive[nHeight]) || outPoint.n >= tx->vout.size())
+        return false;
+    out = tx->vout[outPoint.n];
+    return true;
 }
 
-std::size_t indexOf(const std::vector<CClaimNsupports>& source, const uint160& claimId)
+/** Add the value and address of a claim or support output, which may have been spent since */
+static void valueAndAddressToJSON(const CCoinsViewCache& coinsCache, const COutPoint& outPoint, int nHeight, UniValue& result)
 {
-    auto it = std::find_if(source.begin(), source.end(), [&claimId](const CClaimNsupports& claimNsupports) {
-        return claimNsupports.claim.claimId == claimId;
-    });
-    assert(it != source.end());
-    return std::distance(source.begin(), it);
+    CTxDestination address;
+
+    // the claim index has spent outputs in one read where the block would have to be loaded
+    CClaimIndexRecord record;
+    if (coinsCache.AccessCoin(outPoint).IsSpent() && g_claimindex && g_claimindex->FindClaim(outPoint, record)) {
+        if (record.op != OP_SUPPORT_CLAIM || !record.value.empty())
+            result.pushKV(T_VALUE, HexStr(record.value));
+        if (ExtractDestination(record.script, address))
+            result.pushKV(T_ADDRESS, EncodeDestination(address));
+        return;
+    }
+
+    CTxOut out;
+    if (getOutput(coinsCache, outPoint, nHeight, out)) {
+        std::string value;
+        if (extractValue(out.scriptPubKey, value))
+            result.pushKV(T_VALUE, value);
+
+        if (ExtractDestination(out.scriptPubKey, address))
+            result.pushKV(T_ADDRESS, EncodeDestination(address));
+    }
 }
 
 UniValue claimToJSON(const CCoinsViewCache& coinsCache, const CClaimValue& claim)
@@ -200,16 +269,7 @@ UniValue claimToJSON(const CCoinsViewCache& coinsCache, const CClaimValue& claim
     if (getClaimById(claim.claimId, targetName))
         result.pushKV(T_NAME, escapeNonUtf8(targetName));
 
-    auto& coin = coinsCache.AccessCoin(claim.outPoint);
-    if (!coin.IsSpent()) {
-        std::string value;
-        if (extractValue(coin.out.scriptPubKey, value))
-            result.pushKV(T_VALUE, value);
-
-        CTxDestination address;
-        if (ExtractDestination(coin.out.scriptPubKey, address))
-            result.pushKV(T_ADDRESS, EncodeDestination(address));
-    }
+    valueAndAddressToJSON(coinsCache, claim.outPoint, claim.nHeight, result);
 
     result.pushKV(T_CLAIMID, claim.claimId.GetHex());
     result.pushKV(T_TXID, claim.outPoint.hash.GetHex());
@@ -225,16 +285,7 @@ UniValue supportToJSON(const CCoinsViewCache& coinsCache, const CSupportValue& s
 {
     UniValue ret(UniValue::VOBJ);
 
-    auto& coin = coinsCache.AccessCoin(support.outPoint);
-    if (!coin.IsSpent()) {
-        std::string value;
-        if (extractValue(coin.out.scriptPubKey, value))
-            ret.pushKV(T_VALUE, value);
-
-        CTxDestination address;
-        if (ExtractDestination(coin.out.scriptPubKey, address))
-            ret.pushKV(T_ADDRESS, EncodeDestination(address));
-    }
+    valueAndAddressToJSON(coinsCache, support.outPoint, support.nHeight, ret);
 
     ret.pushKV(T_TXID, support.outPoint.hash.GetHex());
     ret.pushKV(T_N, (int)support.outPoint.n);
@@ -245,29 +296,21 @@ UniValue supportToJSON(const CCoinsViewCache& coinsCache, const CSupportValue& s
     return ret;
 }
 
-CAmount amountToClaim(const CClaimNsupports& claimNsupports)
-{
-    auto fullAmount = claimNsupports.claim.nAmount;
-    for (auto& support : claimNsupports.supports)
-        fullAmount += support.nAmount;
-    return fullAmount;
-}
-
-UniValue claimAndSupportsToJSON(const CCoinsViewCache& coinsCache, const CClaimNsupports& claimNsupports)
+UniValue claimAndSupportsToJSON(const CCoinsViewCache& coinsCache, const CClaimsForNameView& claims, std::size_t bid)
 {
-    auto& claim = claimNsupports.claim;
-    auto& supports = claimNsupports.supports;
+    auto result = claimToJSON(coinsCache, claims.claim(bid));
 
-    auto result = claimToJSON(coinsCache, claim);
-    result.pushKV(T_EFFECTIVEAMOUNT, claimNsupports.effectiveAmount);
+    auto effectiveAmount = claims.effectiveAmount(bid);
+    result.pushKV(T_EFFECTIVEAMOUNT, effectiveAmount);
 
-    auto fullAmount = amountToClaim(claimNsupports);
-    if (fullAmount > claimNsupports.effectiveAmount)
+    auto fullAmount = claims.fullAmount(bid);
+    if (fullAmount > effectiveAmount)
         result.pushKV(T_PENDINGAMOUNT, fullAmount);
 
     UniValue supportObjs(UniValue::VARR);
-    for (auto& support : supports)
+    claims.forEachSupport(bid, [&](const CSupportValue& support) {
         supportObjs.push_back(supportToJSON(coinsCache, support));
+    });
 
     result.pushKV(T_SUPPORTS, supportObjs);
 
@@ -286,9 +329,46 @@ void validateRequest(const JSONRPCRequest& request, int findex, uint8_t required
         throw std::runtime_error(rpc_help[findex]);
 }
 
+/**
+ * Call fn with the names that have claims, in trie order, as of the block hash in the first parameter.
+ * Only names after the one in the second parameter are visited and no more than the third parameter.
+ */
+static void forEachNameInTrie(const JSONRPCRequest& request, CCoinsViewCache& coinsCache, CClaimTrieCache& trieCache,
+                              std::function<void(const std::string&, const CClaimTrieData&)> fn)
+{
+    if (!request.params.empty() && !request.params[0].isNull()) {
+        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)"));
+        RollBackTo(blockIndex, coinsCache, trieCache);
+    }
+
+    const bool fAfter = request.params.size() > 1 && !request.params[1].isNull();
+    const auto start = fAfter ? request.params[1].get_str() : std::string();
+
+    auto limit = std::numeric_limits<std::size_t>::max();
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        auto value = request.params[2].get_int();
+        if (value <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, T_LIMIT " (optional parameter 3) should be a positive value");
+        limit = value;
+    }
+
+    std::size_t count = 0;
+    trieCache.iterateFrom(start, [&](const std::string& name, const CClaimTrieData& data) {
+        if (ShutdownRequested())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
+
+        boost::this_thread::interruption_point();
+
+        if (data.empty() || (fAfter && name == start))
+            return true;
+        fn(name, data);
+        return ++count < limit;
+    });
+}
+
 static UniValue getclaimsintrie(const JSONRPCRequest& request)
 {
-    validateRequest(request, GETCLAIMSINTRIE, 0, 1);
+    validateRequest(request, GETCLAIMSINTRIE, 0, 3);
 
     if (!IsDeprecatedRPCEnabled("getclaimsintrie")) {
         const auto msg = "getclaimsintrie is deprecated and will be removed in v0.18. To use this command, start with -deprecatedrpc=getclaimsintrie";
@@ -301,21 +381,8 @@ static UniValue getclaimsintrie(const JSONRPCRequest& request)
     CCoinsViewCache coinsCache(pcoinsTip.get());
     CClaimTrieCache trieCache(pclaimTrie);
 
-    if (!request.params.empty()) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     UniValue ret(UniValue::VARR);
-    trieCache.iterate([&ret, &trieCache, &coinsCache] (const std::string& name, const CClaimTrieData& data) {
-        if (ShutdownRequested())
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
-
-        boost::this_thread::interruption_point();
-
-        if (data.empty())
-            return;
-
+    forEachNameInTrie(request, coinsCache, trieCache, [&ret, &coinsCache](const std::string& name, const CClaimTrieData& data) {
         UniValue claims(UniValue::VARR);
         for (auto& claim : data.claims)
             claims.push_back(claimToJSON(coinsCache, claim));
@@ -336,75 +403,96 @@ static UniValue getclaimtrie(const JSONRPCRequest& request)
 
 static UniValue getnamesintrie(const JSONRPCRequest& request)
 {
-    validateRequest(request, GETNAMESINTRIE, 0, 1);
+    validateRequest(request, GETNAMESINTRIE, 0, 3);
 
     LOCK(cs_main);
     CCoinsViewCache coinsCache(pcoinsTip.get());
     CClaimTrieCache trieCache(pclaimTrie);
 
-    if (!request.params.empty()) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[0], T_BLOCKHASH " (optional parameter 1)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
     UniValue ret(UniValue::VARR);
-    trieCache.iterate([&ret](const std::string &name, const CClaimTrieData &data) {
-        if (!data.empty())
-            ret.push_back(escapeNonUtf8(name));
-        if (ShutdownRequested())
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
-
-        boost::this_thread::interruption_point();
+    forEachNameInTrie(request, coinsCache, trieCache, [&ret](const std::string& name, const CClaimTrieData&) {
+        ret.push_back(escapeNonUtf8(name));
     });
 
     return ret;
 }
 
-static UniValue getvalueforname(const JSONRPCRequest& request)
+/** The claim getvalueforname returns: the winning one or the one claimId, which can be partial, is for */
+static UniValue valueForNameToJSON(const CCoinsViewCache& coinsCache, const CClaimsForNameView& claims, const std::string& claimId)
 {
-    validateRequest(request, GETVALUEFORNAME, 1, 2);
+    UniValue ret(UniValue::VOBJ);
+    if (claims.empty())
+        return ret;
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
+    auto bid =
+        claimId.length() == claimIdHexLength ? claims.find(uint160S(claimId)) :
+        !claimId.empty() ? claims.find(claimId) : 0;
 
-    if (request.params.size() > 1) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
+    if (bid == claims.size())
+        return ret;
+
+    ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(claims.getName()));
+    ret.pushKVs(claimAndSupportsToJSON(coinsCache, claims, bid));
+    ret.pushKV(T_LASTTAKEOVERHEIGHT, claims.getLastTakeoverHeight());
+    ret.pushKV(T_BID, (int)bid);
+    ret.pushKV(T_SEQUENCE, (int)seqOf(claims, bid));
+
+    return ret;
+}
+
+static UniValue getvalueforname(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETVALUEFORNAME, 1, 2);
 
     std::string claimId;
     if (request.params.size() > 2)
         ParseClaimtrieId(request.params[2], claimId, T_CLAIMID " (optional parameter 3)");
 
-    const auto name = request.params[0].get_str();
-    UniValue ret(UniValue::VOBJ);
+    auto atTip = claimsAtTip(request, 1);
 
-    auto csToName = trieCache.getClaimsForName(name);
-    if (csToName.claimsNsupports.empty())
-        return ret;
-
-    auto& claimNsupports =
-        claimId.length() == claimIdHexLength ? csToName.find(uint160S(claimId)) :
-        !claimId.empty() ? csToName.find(claimId) : csToName.claimsNsupports[0];
-
-    if (claimNsupports.IsNull())
-        return ret;
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+    const auto claims = atTip ? std::move(*atTip) : claimsAtBlock(request, 1, coinsCache, trieCache);
+    return valueForNameToJSON(coinsCache, claims, claimId);
+}
 
-    std::size_t seq = 0, bid = 0;
-    if (csToName.claimsNsupports.size() > 1) {
-        auto& claimId = claimNsupports.claim.claimId;
-        auto seqOrder = seqSort(csToName.claimsNsupports);
-        seq = indexOf(seqOrder, claimId);
-        bid = indexOf(csToName.claimsNsupports, claimId);
+UniValue resolvenames(const JSONRPCRequest& request)
+{
+    validateRequest(request, RESOLVENAMES, 1, 1);
+
+    // names with the claim id to pick among their claims, empty for the winning one
+    std::vector<std::pair<std::string, std::string>> lookups;
+    for (auto& entry : request.params[0].get_array().getValues()) {
+        lookups.emplace_back();
+        if (entry.isStr()) {
+            lookups.back().first = entry.get_str();
+            continue;
+        }
+        RPCTypeCheckObj(entry, {{T_NAME, UniValueType(UniValue::VSTR)}, {T_CLAIMID, UniValueType(UniValue::VSTR)}}, true, true);
+        lookups.back().first = find_value(entry, T_NAME).get_str();
+        auto& claimId = find_value(entry, T_CLAIMID);
+        if (!claimId.isNull())
+            ParseClaimtrieId(claimId, lookups.back().second, T_CLAIMID " (in parameter 1)");
     }
 
-    ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-    ret.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-    ret.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
-    ret.pushKV(T_BID, (int)bid);
-    ret.pushKV(T_SEQUENCE, (int)seq);
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+    if (request.params.size() > 1)
+        RollBackTo(BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)")), coinsCache, trieCache);
+
+    // look every name up once, in order, so names sharing a path walk the same nodes one after another
+    std::set<std::string> names;
+    for (auto& lookup : lookups)
+        names.insert(lookup.first);
+    std::map<std::string, CClaimsForNameView> claimsByName;
+    for (auto& name : names)
+        claimsByName.emplace(name, trieCache.viewClaimsForName(name));
 
+    UniValue ret(UniValue::VARR);
+    for (auto& lookup : lookups)
+        ret.push_back(valueForNameToJSON(coinsCache, claimsByName.at(lookup.first), lookup.second));
     return ret;
 }
 
@@ -412,38 +500,36 @@ UniValue getclaimsforname(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMSFORNAME, 1, 1);
 
+    auto atTip = claimsAtTip(request, 1);
+
     LOCK(cs_main);
     CCoinsViewCache coinsCache(pcoinsTip.get());
     CClaimTrieCache trieCache(pclaimTrie);
-
-    if (request.params.size() > 1) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[1], T_BLOCKHASH " (optional parameter 2)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
-
-    std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    const auto claims = atTip ? std::move(*atTip) : claimsAtBlock(request, 1, coinsCache, trieCache);
 
     UniValue result(UniValue::VOBJ);
-    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
+    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(claims.getName()));
 
-    auto seqOrder = seqSort(csToName.claimsNsupports);
+    auto seqOrder = claims.seqOrder();
+    std::vector<std::size_t> seqs(seqOrder.size());
+    for (std::size_t seq = 0; seq < seqOrder.size(); ++seq)
+        seqs[seqOrder[seq]] = seq;
 
     UniValue claimObjs(UniValue::VARR);
-    for (std::size_t i = 0; i < csToName.claimsNsupports.size(); ++i) {
-        auto& claimNsupports = csToName.claimsNsupports[i];
-        auto claim = claimAndSupportsToJSON(coinsCache, claimNsupports);
+    for (std::size_t i = 0; i < claims.size(); ++i) {
+        auto claim = claimAndSupportsToJSON(coinsCache, claims, i);
         claim.pushKV(T_BID, (int)i);
-        claim.pushKV(T_SEQUENCE, (int)indexOf(seqOrder, claimNsupports.claim.claimId));
+        claim.pushKV(T_SEQUENCE, (int)seqs[i]);
         claimObjs.push_back(claim);
     }
 
     UniValue unmatchedSupports(UniValue::VARR);
-    for (auto& support : csToName.unmatchedSupports)
+    claims.forEachUnmatchedSupport([&](const CSupportValue& support) {
         unmatchedSupports.push_back(supportToJSON(coinsCache, support));
+    });
 
     result.pushKV(T_CLAIMS, claimObjs);
-    result.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
+    result.pushKV(T_LASTTAKEOVERHEIGHT, claims.getLastTakeoverHeight());
     result.pushKV(T_SUPPORTSWITHOUTCLAIM, unmatchedSupports);
     return result;
 }
@@ -452,10 +538,6 @@ UniValue getclaimbybid(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMBYBID, 1, 2);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
     int bid = 0;
     if (request.params.size() > 1)
         bid = request.params[1].get_int();
@@ -463,31 +545,23 @@ UniValue getclaimbybid(const JSONRPCRequest& request)
     if (bid < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, T_BID " (parameter 2) should not be a negative value");
 
-    if (request.params.size() > 2) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[2], T_BLOCKHASH " (optional parameter 3)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
+    auto atTip = claimsAtTip(request, 2);
 
-    std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+    const auto claims = atTip ? std::move(*atTip) : claimsAtBlock(request, 2, coinsCache, trieCache);
 
     UniValue result(UniValue::VOBJ);
 
-    if (uint32_t(bid) >= csToName.claimsNsupports.size())
+    if (uint32_t(bid) >= claims.size())
         return result;
 
-    auto& claimNsupports = csToName.claimsNsupports[bid];
-    std::size_t seq = 0;
-    if (csToName.claimsNsupports.size() > 1) {
-        auto seqOrder = seqSort(csToName.claimsNsupports);
-        seq = indexOf(seqOrder, claimNsupports.claim.claimId);
-    }
-
-    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-    result.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-    result.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
+    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(claims.getName()));
+    result.pushKVs(claimAndSupportsToJSON(coinsCache, claims, bid));
+    result.pushKV(T_LASTTAKEOVERHEIGHT, claims.getLastTakeoverHeight());
     result.pushKV(T_BID, bid);
-    result.pushKV(T_SEQUENCE, (int)seq);
+    result.pushKV(T_SEQUENCE, (int)seqOf(claims, bid));
     return result;
 }
 
@@ -495,10 +569,6 @@ UniValue getclaimbyseq(const JSONRPCRequest& request)
 {
     validateRequest(request, GETCLAIMBYSEQ, 1, 2);
 
-    LOCK(cs_main);
-    CCoinsViewCache coinsCache(pcoinsTip.get());
-    CClaimTrieCache trieCache(pclaimTrie);
-
     int seq = 0;
     if (request.params.size() > 1)
         seq = request.params[1].get_int();
@@ -506,31 +576,23 @@ UniValue getclaimbyseq(const JSONRPCRequest& request)
     if (seq < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, T_SEQUENCE " (parameter 2) should not be a negative value");
 
-    if (request.params.size() > 2) {
-        CBlockIndex* blockIndex = BlockHashIndex(ParseHashV(request.params[2], T_BLOCKHASH " (optional parameter 3)"));
-        RollBackTo(blockIndex, coinsCache, trieCache);
-    }
+    auto atTip = claimsAtTip(request, 2);
 
-    std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+    CClaimTrieCache trieCache(pclaimTrie);
+    const auto claims = atTip ? std::move(*atTip) : claimsAtBlock(request, 2, coinsCache, trieCache);
 
     UniValue result(UniValue::VOBJ);
 
-    if (uint32_t(seq) >= csToName.claimsNsupports.size())
+    if (uint32_t(seq) >= claims.size())
         return result;
 
-    std::size_t bid = 0;
-    const auto claimNsupports = [&bid, &seq, &csToName]() -> CClaimNsupports {
-        if (csToName.claimsNsupports.size() == 1)
-            return csToName.claimsNsupports[0];
-        auto claimNsupports = seqSort(csToName.claimsNsupports)[seq];
-        bid = indexOf(csToName.claimsNsupports, claimNsupports.claim.claimId);
-        return claimNsupports;
-    }();
-
-    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-    result.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-    result.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
+    auto bid = claims.size() == 1 ? 0 : claims.seqOrder()[seq];
+
+    result.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(claims.getName()));
+    result.pushKVs(claimAndSupportsToJSON(coinsCache, claims, bid));
+    result.pushKV(T_LASTTAKEOVERHEIGHT, claims.getLastTakeoverHeight());
     result.pushKV(T_BID, (int)bid);
     result.pushKV(T_SEQUENCE, seq);
     return result;
@@ -555,20 +617,14 @@ UniValue getclaimbyid(const JSONRPCRequest& request)
     UniValue ret(UniValue::VOBJ);
     bool found = claimId.length() == claimIdHexLength && getClaimById(uint160S(claimId), name, &claim);
     if (found || getClaimById(claimId, name, &claim)) {
-        auto csToName = trieCache.getClaimsForName(name);
-        auto& claimNsupports = csToName.find(claim.claimId);
-        if (!claimNsupports.IsNull()) {
-            std::size_t seq = 0, bid = 0;
-            if (csToName.claimsNsupports.size() > 1) {
-                auto seqOrder = seqSort(csToName.claimsNsupports);
-                seq = indexOf(seqOrder, claim.claimId);
-                bid = indexOf(csToName.claimsNsupports, claim.claimId);
-            }
-            ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(csToName.name));
-            ret.pushKVs(claimAndSupportsToJSON(coinsCache, claimNsupports));
-            ret.pushKV(T_LASTTAKEOVERHEIGHT, csToName.nLastTakeoverHeight);
+        auto claims = trieCache.viewClaimsForName(name);
+        auto bid = claims.find(claim.claimId);
+        if (bid != claims.size()) {
+            ret.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(claims.getName()));
+            ret.pushKVs(claimAndSupportsToJSON(coinsCache, claims, bid));
+            ret.pushKV(T_LASTTAKEOVERHEIGHT, claims.getLastTakeoverHeight());
             ret.pushKV(T_BID, (int)bid);
-            ret.pushKV(T_SEQUENCE, (int)seq);
+            ret.pushKV(T_SEQUENCE, (int)seqOf(claims, bid));
         }
     }
     return ret;
@@ -792,10 +848,10 @@ UniValue getclaimproofbybid(const JSONRPCRequest& request)
 
     std::function<bool(const CClaimValue&)> comp;
     if (bid) {
-        auto csToName = trieCache.getClaimsForName(name);
-        if (uint32_t(bid) >= csToName.claimsNsupports.size())
+        auto claims = trieCache.viewClaimsForName(name);
+        if (uint32_t(bid) >= claims.size())
             return {UniValue::VARR};
-        auto claimId = csToName.claimsNsupports[bid].claim.claimId;
+        auto claimId = claims.claim(bid).claimId;
         comp = [claimId](const CClaimValue& claim) {
             return claim.claimId == claimId;
         };
@@ -829,13 +885,12 @@ UniValue getclaimproofbyseq(const JSONRPCRequest& request)
     }
 
     std::string name = request.params[0].get_str();
-    auto csToName = trieCache.getClaimsForName(name);
-    if (uint32_t(seq) >= csToName.claimsNsupports.size())
+    auto claims = trieCache.viewClaimsForName(name);
+    if (uint32_t(seq) >= claims.size())
         return {UniValue::VARR};
 
     std::function<bool(const CClaimValue&)> comp;
-    auto claimId = (csToName.claimsNsupports.size() == 1 ?
-        csToName.claimsNsupports[0] : seqSort(csToName.claimsNsupports)[seq]).claim.claimId;
+    auto claimId = claims.claim(claims.size() == 1 ? 0 : claims.seqOrder()[seq]).claimId;
     comp = [&claimId](const CClaimValue& claim) {
         return claim.claimId == claimId;
     };
@@ -902,11 +957,211 @@ UniValue checknormalization(const JSONRPCRequest& request)
     return triecache.normalizeClaimName(name, force);
 }
 
+static UniValue dumpclaimtrie(const JSONRPCRequest& request)
+{
+    validateRequest(request, DUMPCLAIMTRIE, 1, 0);
+
+    fs::path path = fs::absolute(request.params[0].get_str());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+
+    std::shared_ptr<const CClaimTrieSnapshot> snapshot;
+    const CBlockIndex* tip;
+    {
+        // the published snapshot is the one of the tip, writing it out doesn't need the lock
+        LOCK(cs_main);
+        snapshot = pclaimTrie->getSnapshot();
+        tip = chainActive.Tip();
+    }
+
+    std::size_t nEntries = 0;
+    if (!snapshot->writeToFile(path, tip, nEntries))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write the claim trie snapshot to " + path.string());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV(T_FILENAME, path.string());
+    ret.pushKV(T_HEIGHT, tip->nHeight);
+    ret.pushKV(T_BLOCKHASH, tip->GetBlockHash().GetHex());
+    ret.pushKV(T_ENTRIES, uint64_t(nEntries));
+    return ret;
+}
+
+UniValue getclaimhistory(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETCLAIMHISTORY, 1, 2);
+
+    if (!g_claimhistoryindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The claim history index is not enabled, restart with -claimhistoryindex");
+
+    std::string claimId;
+    ParseClaimtrieId(request.params[0], claimId, T_CLAIMID " (parameter 1)");
+    if (claimId.length() != claimIdHexLength)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, T_CLAIMID " (parameter 1) must be a full claimId");
+
+    int nStartHeight = 0;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nStartHeight = request.params[1].get_int();
+
+    auto limit = std::numeric_limits<std::size_t>::max();
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        auto value = request.params[2].get_int();
+        if (value <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, T_LIMIT " (optional parameter 3) should be a positive value");
+        limit = value;
+    }
+
+    g_claimhistoryindex->BlockUntilSyncedToCurrentChain();
+    std::vector<CClaimHistoryEvent> events;
+    g_claimhistoryindex->GetHistory(uint160S(claimId), nStartHeight, limit, events);
+
+    static const char* eventNames[] = { "claim", "update", "abandon", "support", "abandonsupport" };
+    UniValue ret(UniValue::VARR);
+    for (auto& event : events) {
+        UniValue o(UniValue::VOBJ);
+        o.pushKV(T_EVENT, eventNames[event.type]);
+        o.pushKV(T_NAME, escapeNonUtf8(event.name));
+        if (!event.value.empty() || event.type == CClaimHistoryEvent::CLAIMED)
+            o.pushKV(T_VALUE, HexStr(event.value));
+        o.pushKV(T_TXID, event.outPoint.hash.GetHex());
+        o.pushKV(T_N, (int)event.outPoint.n);
+        o.pushKV(T_AMOUNT, event.nAmount);
+        o.pushKV(T_HEIGHT, event.nHeight);
+        o.pushKV(T_BLOCKHASH, event.hashBlock.GetHex());
+        ret.push_back(o);
+    }
+    return ret;
+}
+
+UniValue getsupportsbyclaimid(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETSUPPORTSBYCLAIMID, 1, 0);
+
+    std::string claimId;
+    ParseClaimtrieId(request.params[0], claimId, T_CLAIMID " (parameter 1)");
+    if (claimId.length() != claimIdHexLength)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, T_CLAIMID " (parameter 1) must be a full claimId");
+
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+
+    UniValue ret(UniValue::VARR);
+    for (auto& element : pclaimTrie->getSupportsForClaimId(uint160S(claimId))) {
+        UniValue o(UniValue::VOBJ);
+        o.pushKV(T_NAME, escapeNonUtf8(element.name));
+        o.pushKVs(supportToJSON(coinsCache, element.support));
+        ret.push_back(o);
+    }
+    return ret;
+}
+
+UniValue gettopclaims(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETTOPCLAIMS, 0, 2);
+
+    if (!pclaimTrie->hasRanking())
+        throw JSONRPCError(RPC_MISC_ERROR, "The claim ranking is not kept, restart with -claimtrieranking");
+
+    int start = 0;
+    if (!request.params.empty() && !request.params[0].isNull()) {
+        start = request.params[0].get_int();
+        if (start < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, T_START " (optional parameter 1) should not be negative");
+    }
+
+    auto limit = std::numeric_limits<std::size_t>::max();
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        auto value = request.params[1].get_int();
+        if (value <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, T_LIMIT " (optional parameter 2) should be a positive value");
+        limit = value;
+    }
+
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+
+    UniValue ret(UniValue::VARR);
+    for (auto& top : pclaimTrie->getTopClaims(start, limit)) {
+        auto it = pclaimTrie->find(top.first);
+        if (!it || it->empty())
+            continue;
+        UniValue o(UniValue::VOBJ);
+        o.pushKV(T_NORMALIZEDNAME, escapeNonUtf8(top.first));
+        o.pushKVs(claimToJSON(coinsCache, it->claims.front()));
+        o.pushKV(T_EFFECTIVEAMOUNT, top.second);
+        o.pushKV(T_LASTTAKEOVERHEIGHT, it->nHeightOfLastTakeover);
+        ret.push_back(o);
+    }
+    return ret;
+}
+
+UniValue getexpiringclaims(const JSONRPCRequest& request)
+{
+    validateRequest(request, GETEXPIRINGCLAIMS, 1, 1);
+
+    int nStartHeight = request.params[0].get_int();
+    int nEndHeight = nStartHeight;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nEndHeight = request.params[1].get_int();
+    if (nEndHeight < nStartHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, T_ENDHEIGHT " (optional parameter 2) should not be below " T_STARTHEIGHT);
+
+    LOCK(cs_main);
+    CCoinsViewCache coinsCache(pcoinsTip.get());
+
+    // the rows of the blocks in the chain are gone and nothing expires later than what the next block adds
+    const auto& consensus = Params().GetConsensus();
+    const int nNextHeight = chainActive.Height() + 1;
+    nStartHeight = std::max(nStartHeight, nNextHeight);
+    nEndHeight = std::min<int64_t>(nEndHeight, nNextHeight + std::max(consensus.nOriginalClaimExpirationTime, consensus.nExtendedClaimExpirationTime));
+    if (nEndHeight - nStartHeight >= MAX_RPC_EXPIRING_HEIGHTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Cannot look up more than %d heights at once, "
+            "pass the " T_ENDHEIGHT " of the last window + 1 as the next " T_STARTHEIGHT, MAX_RPC_EXPIRING_HEIGHTS));
+
+    UniValue ret(UniValue::VARR);
+    // the heights are little endian in the row keys, so the rows are read one by one rather than in a range
+    for (int nHeight = nStartHeight; nHeight <= nEndHeight; ++nHeight) {
+        if (ShutdownRequested())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Shutdown requested");
+
+        boost::this_thread::interruption_point();
+
+        for (uint8_t rowKey : { CLAIM_EXP_QUEUE_ROW, SUPPORT_EXP_QUEUE_ROW }) {
+            expirationQueueRowType row;
+            if (!pclaimTrie->read(std::make_pair(rowKey, nHeight), row))
+                continue;
+            for (auto& entry : row) {
+                UniValue o(UniValue::VOBJ);
+                o.pushKV(T_CLAIMTYPE, rowKey == CLAIM_EXP_QUEUE_ROW ? "claim" : "support");
+                o.pushKV(T_NAME, escapeNonUtf8(entry.name));
+                // a spend takes the output out of the queue, the rest is read from the unspent output
+                const Coin& coin = coinsCache.AccessCoin(entry.outPoint);
+                int op;
+                std::vector<std::vector<unsigned char>> vvchParams;
+                if (!coin.IsSpent() && DecodeClaimScript(coin.out.scriptPubKey, op, vvchParams)) {
+                    auto claimId = op == OP_CLAIM_NAME ? ClaimIdHash(entry.outPoint.hash, entry.outPoint.n) : uint160(vvchParams[1]);
+                    o.pushKV(T_CLAIMID, claimId.GetHex());
+                }
+                o.pushKV(T_TXID, entry.outPoint.hash.GetHex());
+                o.pushKV(T_N, (int)entry.outPoint.n);
+                if (!coin.IsSpent()) {
+                    o.pushKV(T_AMOUNT, coin.out.nValue);
+                    CTxDestination address;
+                    if (ExtractDestination(coin.out.scriptPubKey, address))
+                        o.pushKV(T_ADDRESS, EncodeDestination(address));
+                }
+                o.pushKV(T_EXPIRATIONHEIGHT, nHeight);
+                ret.push_back(o);
+            }
+        }
+    }
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
-    { "Claimtrie",          "getclaimsintrie",              &getclaimsintrie,           { T_BLOCKHASH } },
-    { "Claimtrie",          "getnamesintrie",               &getnamesintrie,            { T_BLOCKHASH } },
+    { "Claimtrie",          "getclaimsintrie",              &getclaimsintrie,           { T_BLOCKHASH,T_START,T_LIMIT } },
+    { "Claimtrie",          "getnamesintrie",               &getnamesintrie,            { T_BLOCKHASH,T_START,T_LIMIT } },
     { "hidden",             "getclaimtrie",                 &getclaimtrie,              { } },
     { "Claimtrie",          "getvalueforname",              &getvalueforname,           { T_NAME,T_BLOCKHASH,T_CLAIMID } },
     { "Claimtrie",          "getclaimsforname",             &getclaimsforname,          { T_NAME,T_BLOCKHASH } },
@@ -922,6 +1177,12 @@ static const CRPCCommand commands[] =
     { "Claimtrie",          "getclaimbyseq",                &getclaimbyseq,             { T_NAME,T_SEQUENCE,T_BLOCKHASH } },
     { "Claimtrie",          "getchangesinblock",            &getchangesinblock,         { T_BLOCKHASH } },
     { "Claimtrie",          "checknormalization",           &checknormalization,        { T_NAME } },
+    { "Claimtrie",          "dumpclaimtrie",                &dumpclaimtrie,             { T_FILENAME } },
+    { "Claimtrie",          "resolvenames",                 &resolvenames,              { T_NAMES,T_BLOCKHASH } },
+    { "Claimtrie",          "getclaimhistory",              &getclaimhistory,           { T_CLAIMID,T_START,T_LIMIT } },
+    { "Claimtrie",          "getsupportsbyclaimid",         &getsupportsbyclaimid,      { T_CLAIMID } },
+    { "Claimtrie",          "gettopclaims",                 &gettopclaims,              { T_START,T_LIMIT } },
+    { "Claimtrie",          "getexpiringclaims",            &getexpiringclaims,         { T_STARTHEIGHT,T_ENDHEIGHT } },
 };
 
 void RegisterClaimTrieRPCCommands(CRPCTable &tableRPC)
@@ -181,6 +181,15 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getclaimproofbyseq", 1, "sequence"},
     { "supportclaim", 4, "isTip"},
     { "gettotalvalueofclaims", 0, "controlling_only"},
+    { "resolvenames", 0, "names"},
+    { "getclaimhistory", 1, "start"},
+    { "getclaimhistory", 2, "limit"},
+    { "gettopclaims", 0, "start"},
+    { "gettopclaims", 1, "limit"},
+    { "getexpiringclaims", 0, "startHeight"},
+    { "getexpiringclaims", 1, "endHeight"},
+    { "getclaimsintrie", 2, "limit"},
+    { "getnamesintrie", 2, "limit"},
 };
 
 class CRPCConvertTable
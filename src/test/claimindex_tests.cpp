@@ -0,0 +1,88 @@
+// Copyright (c) 2015-2019 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://opensource.org/licenses/mit-license.php
+
+#include <index/claimindex.h>
+#include <test/claimtriefixture.h>
+#include <utiltime.h>
+
+BOOST_FIXTURE_TEST_SUITE(claimindex_tests, RegTestingSetup)
+
+static void WaitForSync(ClaimIndex& claimindex)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!claimindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(claimindex_spent_and_expired)
+{
+    ClaimTrieChainFixture fixture;
+    ClaimIndex claimindex(1 << 20, true);
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    uint160 claimId1 = ClaimIdHash(tx1.GetHash(), 0);
+    fixture.IncrementBlocks(1);
+    CClaimIndexRecord record;
+    BOOST_CHECK(!claimindex.FindClaim(COutPoint(tx1.GetHash(), 0), record));
+
+    // blocks from before the index started are synced
+    claimindex.Start();
+    WaitForSync(claimindex);
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(tx1.GetHash(), 0), record));
+    BOOST_CHECK_EQUAL(record.op, OP_CLAIM_NAME);
+    BOOST_CHECK_EQUAL(record.name, "test");
+    BOOST_CHECK_EQUAL(record.value, "one");
+    BOOST_CHECK_EQUAL(record.claimId, claimId1);
+    BOOST_CHECK_EQUAL(record.nAmount, 2);
+    BOOST_CHECK_EQUAL(record.nHeight, chainActive.Height());
+    BOOST_CHECK(!record.IsSpent());
+
+    // and so are the new ones
+    int nUpdateHeight = chainActive.Height() + 1;
+    CMutableTransaction u1 = fixture.MakeUpdate(tx1, "test", "two", claimId1, 2);
+    CMutableTransaction s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(claimindex.BlockUntilSyncedToCurrentChain());
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(tx1.GetHash(), 0), record));
+    BOOST_CHECK_EQUAL(record.value, "one");
+    BOOST_CHECK_EQUAL(record.nSpentHeight, nUpdateHeight);
+    BOOST_CHECK(!ClaimIndex::IsExpired(record));
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(u1.GetHash(), 0), record));
+    BOOST_CHECK_EQUAL(record.op, OP_UPDATE_CLAIM);
+    BOOST_CHECK_EQUAL(record.value, "two");
+    BOOST_CHECK_EQUAL(record.claimId, claimId1);
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(s1.GetHash(), 0), record));
+    BOOST_CHECK_EQUAL(record.op, OP_SUPPORT_CLAIM);
+    BOOST_CHECK_EQUAL(record.claimId, claimId1);
+    BOOST_CHECK_EQUAL(record.nAmount, 1);
+
+    // the records of a disconnected block are not returned, nor are its spends
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK(!claimindex.FindClaim(COutPoint(u1.GetHash(), 0), record));
+    BOOST_CHECK(!claimindex.FindClaim(COutPoint(s1.GetHash(), 0), record));
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(tx1.GetHash(), 0), record));
+    BOOST_CHECK(!record.IsSpent());
+    mempool.clear();
+
+    // a claim still around at the expiration fork gets the extended expiration time
+    fixture.setExpirationForkHeight(5, 20, 40);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "expire", "three", 1);
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(claimindex.BlockUntilSyncedToCurrentChain());
+    BOOST_REQUIRE(claimindex.FindClaim(COutPoint(tx2.GetHash(), 0), record));
+    BOOST_CHECK_EQUAL(record.ExpirationHeight(), record.nHeight + 40);
+    fixture.IncrementBlocks(39);
+    BOOST_CHECK(!ClaimIndex::IsExpired(record));
+    BOOST_CHECK(pclaimTrie->find("expire"));
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(ClaimIndex::IsExpired(record));
+    BOOST_CHECK(!pclaimTrie->find("expire"));
+
+    claimindex.Stop(); // Stop thread before calling destructor
+}
+
+BOOST_AUTO_TEST_SUITE_END()
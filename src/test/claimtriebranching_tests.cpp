@@ -3,6 +3,7 @@
 // file COPYING or http://opensource.org/licenses/mit-license.php
 
 #include <test/claimtriefixture.h>
+#include <validationinterface.h>
 
 using namespace std;
 
@@ -1866,4 +1867,194 @@ BOOST_AUTO_TEST_CASE(update_on_support2_test)
     BOOST_CHECK_EQUAL(it->nHeightOfLastTakeover, height + 1);
 }
 
+BOOST_AUTO_TEST_CASE(disconnect_many_blocks_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto pindexFork = chainActive.Tip();
+
+    // claims, takeovers, supports and spends spread over the blocks that get disconnected together
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "one", "1", 2);
+    fixture.IncrementBlocks(1);
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "one", "2", 3);
+    CMutableTransaction tx3 = fixture.MakeClaim(fixture.GetCoinbase(), "two", "3", 1);
+    fixture.IncrementBlocks(5);
+    CMutableTransaction s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "one", 5);
+    fixture.IncrementBlocks(5);
+    fixture.Spend(tx3);
+    CMutableTransaction u1 = fixture.MakeUpdate(tx2, "one", "4", ClaimIdHash(tx2.GetHash(), 0), 3);
+    fixture.IncrementBlocks(5);
+    BOOST_CHECK(fixture.is_best_claim("one", tx1));
+    BOOST_CHECK(!pclaimTrie->find("two"));
+    auto pindexTip = chainActive.Tip();
+
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Next(pindexFork)));
+    }
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK_EQUAL(chainActive.Tip(), pindexFork);
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), pindexFork->hashClaimTrie);
+    BOOST_CHECK(!pclaimTrie->find("one"));
+    BOOST_CHECK(fixture.queueEmpty());
+    BOOST_CHECK(fixture.supportQueueEmpty());
+
+    {
+        LOCK(cs_main);
+        ResetBlockFailureFlags(pindexTip->GetAncestor(pindexFork->nHeight + 1));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK_EQUAL(chainActive.Tip(), pindexTip);
+    BOOST_CHECK(fixture.is_best_claim("one", tx1));
+    mempool.clear();
+}
+
+struct ClaimTrieChangesCollector : public CValidationInterface
+{
+    std::vector<std::shared_ptr<const CClaimTrieBlockChanges>> blocks;
+
+    ClaimTrieChangesCollector()
+    {
+        RegisterValidationInterface(this);
+        fClaimTrieChanges = true;
+    }
+
+    ~ClaimTrieChangesCollector()
+    {
+        fClaimTrieChanges = false;
+        UnregisterValidationInterface(this);
+    }
+
+    void ClaimTrieChanged(const std::shared_ptr<const CClaimTrieBlockChanges>& changes) override
+    {
+        blocks.push_back(changes);
+    }
+
+    // the changes of the one block sent since the last call
+    CClaimTrieBlockChanges take()
+    {
+        SyncWithValidationInterfaceQueue();
+        BOOST_REQUIRE_EQUAL(blocks.size(), 1U);
+        auto changes = *blocks.back();
+        blocks.clear();
+        return changes;
+    }
+};
+
+static const CClaimTrieChange* findChange(const CClaimTrieBlockChanges& block, uint8_t type, const uint160& claimId)
+{
+    for (auto& change : block.changes)
+        if (change.type == type && change.claimId == claimId)
+            return &change;
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(claim_trie_changed_test)
+{
+    ClaimTrieChainFixture fixture;
+    ClaimTrieChangesCollector collector;
+
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    uint160 claimId1 = ClaimIdHash(tx1.GetHash(), 0);
+    fixture.IncrementBlocks(1);
+    auto block = collector.take();
+    BOOST_CHECK(block.fConnected);
+    BOOST_CHECK_EQUAL(block.nHeight, chainActive.Height());
+    BOOST_CHECK_EQUAL(block.hashBlock, chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(block.changes.size(), 2U);
+    auto change = findChange(block, CClaimTrieChange::CLAIM_ADDED, claimId1);
+    BOOST_REQUIRE(change);
+    BOOST_CHECK_EQUAL(change->name, "test");
+    BOOST_CHECK_EQUAL(change->outPoint, COutPoint(tx1.GetHash(), 0));
+    BOOST_CHECK_EQUAL(change->nEffectiveAmount, 2);
+    BOOST_CHECK(findChange(block, CClaimTrieChange::TAKEOVER, claimId1));
+
+    // a later claim waits before it can take over
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "two", 3);
+    uint160 claimId2 = ClaimIdHash(tx2.GetHash(), 0);
+    CMutableTransaction s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(1);
+    block = collector.take();
+    BOOST_CHECK_EQUAL(block.changes.size(), 2U);
+    BOOST_CHECK(findChange(block, CClaimTrieChange::CLAIM_ADDED, claimId2));
+    change = findChange(block, CClaimTrieChange::SUPPORT_ADDED, claimId1);
+    BOOST_REQUIRE(change);
+    BOOST_CHECK_EQUAL(change->outPoint, COutPoint(s1.GetHash(), 0));
+    BOOST_CHECK_EQUAL(change->nEffectiveAmount, 3);
+
+    // updating the controlling claim activates the waiting one early, which wins the tie
+    CMutableTransaction u1 = fixture.MakeUpdate(tx1, "test", "three", claimId1, 2);
+    fixture.IncrementBlocks(1);
+    block = collector.take();
+    BOOST_CHECK_EQUAL(block.changes.size(), 3U);
+    change = findChange(block, CClaimTrieChange::CLAIM_UPDATED, claimId1);
+    BOOST_REQUIRE(change);
+    BOOST_CHECK_EQUAL(change->outPoint, COutPoint(u1.GetHash(), 0));
+    BOOST_CHECK(findChange(block, CClaimTrieChange::CLAIM_ACTIVATED, claimId2));
+    BOOST_CHECK(findChange(block, CClaimTrieChange::TAKEOVER, claimId2));
+    BOOST_CHECK(fixture.is_best_claim("test", tx2));
+
+    fixture.Spend(s1);
+    fixture.IncrementBlocks(1);
+    block = collector.take();
+    BOOST_CHECK_EQUAL(block.changes.size(), 1U);
+    BOOST_CHECK(findChange(block, CClaimTrieChange::SUPPORT_REMOVED, claimId1));
+
+    // disconnecting a block sends what it had changed
+    auto hashBlock = chainActive.Tip()->GetBlockHash();
+    fixture.DecrementBlocks(1);
+    block = collector.take();
+    BOOST_CHECK(!block.fConnected);
+    BOOST_CHECK_EQUAL(block.hashBlock, hashBlock);
+    BOOST_CHECK_EQUAL(block.changes.size(), 1U);
+    BOOST_CHECK(findChange(block, CClaimTrieChange::SUPPORT_REMOVED, claimId1));
+
+    // and they go out as one message
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    CClaimTrieBlockChanges read;
+    ss >> read;
+    BOOST_CHECK_EQUAL(read.hashBlock, block.hashBlock);
+    BOOST_CHECK_EQUAL(read.fConnected, block.fConnected);
+    BOOST_REQUIRE_EQUAL(read.changes.size(), 1U);
+    BOOST_CHECK_EQUAL(read.changes[0].outPoint, block.changes[0].outPoint);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(disconnect_many_blocks_full_cache_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto pindexFork = chainActive.Tip();
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "one", "1", 2);
+    fixture.IncrementBlocks(1);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "one", 3);
+    fixture.IncrementBlocks(1);
+    fixture.Spend(tx1);
+    fixture.IncrementBlocks(2);
+    auto pindexTip = chainActive.Tip();
+
+    // with no room for the coins every block is flushed, moved past and announced on its own, tip first
+    ClaimTrieChangesCollector collector;
+    const auto nCoinCacheUsageOriginal = nCoinCacheUsage;
+    nCoinCacheUsage = 0;
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Next(pindexFork)));
+    }
+    nCoinCacheUsage = nCoinCacheUsageOriginal;
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK_EQUAL(chainActive.Tip(), pindexFork);
+    BOOST_CHECK_EQUAL(CClaimTrieCache(pclaimTrie).getMerkleHash(), pindexFork->hashClaimTrie);
+    BOOST_CHECK(!pclaimTrie->find("one"));
+
+    SyncWithValidationInterfaceQueue();
+    BOOST_REQUIRE_EQUAL(collector.blocks.size(), 4U);
+    for (std::size_t i = 0; i < collector.blocks.size(); ++i) {
+        BOOST_CHECK(!collector.blocks[i]->fConnected);
+        BOOST_CHECK_EQUAL(collector.blocks[i]->hashBlock, pindexTip->GetAncestor(pindexTip->nHeight - i)->GetBlockHash());
+    }
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
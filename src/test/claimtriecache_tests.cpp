@@ -1,4 +1,5 @@
 #include <claimtrie.h>
+#include <consensus/merkle.h>
 #include <nameclaim.h>
 #include <uint256.h>
 #include <validation.h>
@@ -314,6 +315,234 @@ BOOST_AUTO_TEST_CASE(trie_stays_consistent_test)
     BOOST_CHECK(trie.empty());
 }
 
+BOOST_AUTO_TEST_CASE(subtree_consistency_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    for (int i = 0; i < 100; ++i) {
+        CClaimValue value;
+        value.outPoint = COutPoint(uint256S(std::to_string(i)), i);
+        BOOST_CHECK(cache.insertClaimIntoTrie("n" + std::to_string(i), value, false));
+    }
+    BOOST_CHECK(cache.flush());
+
+    std::vector<std::string> top, subtrees;
+    cache.splitForConsistencyCheck(8, top, subtrees);
+    BOOST_CHECK(!top.empty());
+    BOOST_CHECK_GE(subtrees.size(), 8);
+    for (auto& name: subtrees)
+        BOOST_CHECK(cache.checkConsistency(name, true));
+    for (auto& name: top)
+        BOOST_CHECK(cache.checkConsistency(name, false));
+
+    // a broken leaf only fails the subtree holding it
+    trie.find("n42")->hash = uint256S("1");
+    std::size_t failed = 0;
+    for (auto& name: subtrees)
+        failed += !cache.checkConsistency(name, true);
+    BOOST_CHECK_EQUAL(failed, 1);
+    for (auto& name: top)
+        BOOST_CHECK(cache.checkConsistency(name, false));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_hash_test)
+{
+    auto fill = [](CClaimTrieCacheTest& cache) {
+        for (int i = 0; i < 500; ++i) {
+            auto name = "name" + std::to_string(i * 7919 % 1000);
+            CClaimValue value;
+            value.outPoint = COutPoint(uint256S(std::to_string(i)), i);
+            value.claimId = ClaimIdHash(value.outPoint.hash, value.outPoint.n);
+            BOOST_CHECK(cache.insertClaimIntoTrie(name, value, false));
+        }
+    };
+
+    CClaimTrie sequentialTrie(true, false, 1);
+    CClaimTrieCacheTest sequential(&sequentialTrie);
+    fill(sequential);
+    auto expected = sequential.getMerkleHash();
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i)
+        threads.create_thread(&ThreadClaimTrieHash);
+    nClaimTrieHashThreads = 4;
+    BOOST_SCOPE_EXIT(&threads) {
+        nClaimTrieHashThreads = 0;
+        threads.interrupt_all();
+        threads.join_all();
+    } BOOST_SCOPE_EXIT_END
+
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    fill(cache);
+    BOOST_CHECK_EQUAL(expected, cache.getMerkleHash());
+    BOOST_CHECK(cache.flush());
+    BOOST_CHECK(cache.checkConsistency());
+
+    // a broken node deep down is caught by the workers
+    trie.find("name919")->hash = uint256S("1");
+    BOOST_CHECK(!cache.checkConsistency());
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    std::vector<std::string> names;
+    for (int i = 0; i < 200; ++i) {
+        names.push_back("name" + std::to_string(i));
+        CSupportValue support(COutPoint(uint256S(std::to_string(i)), i), uint160(), 10, 0, 0);
+        BOOST_CHECK(cache.insertSupportIntoMap(names.back(), support, false));
+    }
+    BOOST_CHECK(cache.flush());
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i)
+        threads.create_thread(&ThreadClaimTrieHash);
+    nClaimTrieHashThreads = 4;
+    BOOST_SCOPE_EXIT(&threads) {
+        nClaimTrieHashThreads = 0;
+        threads.interrupt_all();
+        threads.join_all();
+    } BOOST_SCOPE_EXIT_END
+
+    // reading alongside the prefetch finds the same rows
+    CClaimTrieCacheTest reader(&trie);
+    auto prefetch = reader.prefetch(names);
+    for (int i = 0; i < 200; ++i)
+        BOOST_CHECK(reader.haveSupport(names[i], COutPoint(uint256S(std::to_string(i)), i)));
+    prefetch->Wait();
+
+    // the hashing threads are free again
+    BOOST_CHECK(reader.checkConsistency());
+}
+
+BOOST_AUTO_TEST_CASE(write_buffer_test)
+{
+    CClaimTrie trie(true, false, 1);
+    trie.setWriteBuffer(1 << 20);
+    CSupportValue support0(COutPoint(uint256S("0"), 0), uint160(), 10, 0, 0);
+    CSupportValue support1(COutPoint(uint256S("1"), 1), uint160(), 10, 0, 0);
+
+    CClaimTrieCacheTest cache(&trie);
+    BOOST_CHECK(cache.insertSupportIntoMap("name0", support0, false));
+    BOOST_CHECK(cache.insertSupportIntoMap("name1", support1, false));
+    BOOST_CHECK(cache.flush());
+
+    // the next block reads what the last one wrote before it gets to the database
+    CClaimTrieCacheTest next(&trie);
+    BOOST_CHECK(next.haveSupport("name0", support0.outPoint));
+    CSupportValue removed;
+    BOOST_CHECK(next.removeSupportFromMap("name0", support0.outPoint, removed, false));
+    BOOST_CHECK(next.flush());
+    BOOST_CHECK(!CClaimTrieCacheTest(&trie).haveSupport("name0", support0.outPoint));
+    BOOST_CHECK(CClaimTrieCacheTest(&trie).haveSupport("name1", support1.outPoint));
+
+    // the snapshot only moves on once they are written out
+    BOOST_CHECK(trie.getSnapshot()->getClaimsForName("name1").unmatchedSupports.empty());
+    BOOST_CHECK(trie.SyncToDisk());
+    BOOST_CHECK(trie.getSnapshot()->getClaimsForName("name0").unmatchedSupports.empty());
+    BOOST_CHECK_EQUAL(trie.getSnapshot()->getClaimsForName("name1").unmatchedSupports.size(), 1U);
+
+    // over the budget every block is written out as it is flushed
+    trie.setWriteBuffer(1);
+    CClaimTrieCacheTest last(&trie);
+    BOOST_CHECK(last.insertSupportIntoMap("name0", support0, false));
+    BOOST_CHECK(last.flush());
+    BOOST_CHECK_EQUAL(trie.getSnapshot()->getClaimsForName("name0").unmatchedSupports.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(read_from_disk_test)
+{
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCacheTest cache(&trie);
+    for (int i = 0; i < 300; ++i) {
+        auto name = "name" + std::to_string(i * 7919 % 100);
+        CClaimValue value;
+        value.outPoint = COutPoint(uint256S(std::to_string(i)), i);
+        value.claimId = ClaimIdHash(value.outPoint.hash, value.outPoint.n);
+        value.nAmount = i % 17 + 1;
+        BOOST_CHECK(cache.insertClaimIntoTrie(name, value, false));
+        if (i % 3 == 0) {
+            CSupportValue support;
+            support.outPoint = COutPoint(uint256S(std::to_string(i)), i + 1);
+            support.supportedClaimId = value.claimId;
+            support.nAmount = 20;
+            BOOST_CHECK(cache.insertSupportIntoMap(name, support, false));
+        }
+    }
+    auto expected = cache.getMerkleHash();
+    BOOST_CHECK(cache.flush());
+
+    auto claims = [&trie]() {
+        std::map<std::string, std::vector<std::pair<uint160, CAmount>>> result;
+        for (auto it = trie.cbegin(); it != trie.cend(); ++it)
+            for (auto& claim : it->claims)
+                result[it.key()].emplace_back(claim.claimId, claim.nEffectiveAmount);
+        return result;
+    };
+    auto expectedClaims = claims();
+    BOOST_CHECK_EQUAL(expectedClaims.size(), 100U);
+
+    CClaimTrieCacheTest sequential(&trie);
+    BOOST_CHECK(sequential.ReadFromDisk(nullptr));
+    BOOST_CHECK_EQUAL(expected, sequential.getMerkleHash());
+    BOOST_CHECK(expectedClaims == claims());
+
+    boost::thread_group threads;
+    for (int i = 0; i < 3; ++i)
+        threads.create_thread(&ThreadClaimTrieHash);
+    nClaimTrieHashThreads = 4;
+    BOOST_SCOPE_EXIT(&threads) {
+        nClaimTrieHashThreads = 0;
+        threads.interrupt_all();
+        threads.join_all();
+    } BOOST_SCOPE_EXIT_END
+
+    CClaimTrieCacheTest parallel(&trie);
+    BOOST_CHECK(parallel.ReadFromDisk(nullptr));
+    BOOST_CHECK_EQUAL(expected, parallel.getMerkleHash());
+    BOOST_CHECK(expectedClaims == claims());
+}
+
+BOOST_AUTO_TEST_CASE(clean_shutdown_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 1);
+    fixture.IncrementBlocks(1);
+
+    // the record only vouches for the tip it was written at, and only once
+    BOOST_CHECK(fixture.writeCleanShutdown());
+    BOOST_CHECK(fixture.readCleanShutdown(chainActive.Tip()));
+    BOOST_CHECK(!fixture.readCleanShutdown(chainActive.Tip()));
+
+    BOOST_CHECK(fixture.writeCleanShutdown());
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(!fixture.readCleanShutdown(chainActive.Tip()));
+
+    // loading without the full check still compares the root
+    BOOST_CHECK(fixture.ReadFromDisk(chainActive.Tip(), false));
+    BOOST_CHECK(fixture.haveClaim("test", fixture.find("test")->claims.front().outPoint));
+    CBlockIndex wrongRoot(*chainActive.Tip());
+    wrongRoot.hashClaimTrie = uint256S("1");
+    BOOST_CHECK(!fixture.ReadFromDisk(&wrongRoot, false));
+    BOOST_CHECK(fixture.ReadFromDisk(chainActive.Tip()));
+
+    // node hashes left for a background check aren't vouched for until it has finished
+    BOOST_CHECK(fixture.ReadFromDisk(chainActive.Tip(), false, true));
+    BOOST_CHECK(!fixture.writeCleanShutdown());
+    CCriticalSection cs;
+    bool fFinished;
+    BOOST_CHECK(pclaimTrie->checkInParts(cs, 2, []() { return true; }, fFinished));
+    BOOST_CHECK(!fFinished);
+    BOOST_CHECK(!fixture.writeCleanShutdown());
+    BOOST_CHECK(!fixture.readCleanShutdown(chainActive.Tip()));
+    BOOST_CHECK(pclaimTrie->checkInParts(cs, 2, []() { return false; }, fFinished));
+    BOOST_CHECK(fFinished);
+    BOOST_CHECK(fixture.writeCleanShutdown());
+    BOOST_CHECK(fixture.readCleanShutdown(chainActive.Tip()));
+}
+
 BOOST_AUTO_TEST_CASE(takeover_workaround_triggers)
 {
     auto& consensus = const_cast<Consensus::Params&>(Params().GetConsensus());
@@ -447,4 +676,55 @@ BOOST_AUTO_TEST_CASE(claimtrienode_remove_invalid_claim)
     BOOST_CHECK_EQUAL(invalidClaim, false);
 }
 
+BOOST_AUTO_TEST_CASE(claimtrienode_memoized_hashes)
+{
+    uint160 hash160;
+
+    CClaimValue v1(COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000001"), 0), hash160, 50, 0, 100);
+    CClaimValue v2(COutPoint(uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"), 1), hash160, 100, 1, 101);
+    CClaimValue v3(COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000003"), 2), hash160, 75, 2, 102);
+
+    auto expected = [](const CClaimTrieData& data) {
+        std::vector<uint256> hashes;
+        for (auto& claim : data.claims)
+            hashes.push_back(getValueHash(claim.outPoint, data.nHeightOfLastTakeover));
+        return hashes;
+    };
+
+    CClaimTrieData n1;
+    n1.insertClaim(v1);
+    n1.insertClaim(v2);
+    BOOST_CHECK(n1.getClaimHashes() == expected(n1));
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+
+    // each change to the claims or the takeover height shows up in the next call
+    n1.nHeightOfLastTakeover = 5;
+    BOOST_CHECK(n1.getClaimHashes() == expected(n1));
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+
+    std::swap(n1.claims[0], n1.claims[1]);
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+
+    n1.insertClaim(v3);
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+
+    CClaimValue throwaway;
+    BOOST_CHECK(n1.removeClaim(v2.outPoint, throwaway));
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+
+    // copies carry the memo and keep it current on their own
+    CClaimTrieData n2 = n1;
+    n2.nHeightOfLastTakeover = 6;
+    // reading a node through const works the hashes out without touching the memo
+    const auto& c2 = n2;
+    BOOST_CHECK(c2.getClaimHashes() == expected(n2));
+    BOOST_CHECK_EQUAL(c2.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n2)));
+    BOOST_CHECK_EQUAL(n2.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n2)));
+    BOOST_CHECK_EQUAL(n1.getClaimsMerkleRoot(), ComputeMerkleRoot(expected(n1)));
+    BOOST_CHECK(n1.getClaimsMerkleRoot() != n2.getClaimsMerkleRoot());
+
+    n2.claims.clear();
+    BOOST_CHECK(n2.getClaimHashes().empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
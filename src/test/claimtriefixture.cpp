@@ -105,6 +105,10 @@ ClaimTrieChainFixture::~ClaimTrieChainFixture()
     }
     if (forkhash_original >= 0)
         consensus.nAllClaimsInMerkleForkHeight = forkhash_original;
+    base->nHistoryDepth = 0;
+    base->fRanking = false;
+    base->topClaims.clear();
+    base->controllingAmounts.clear();
 }
 
 void ClaimTrieChainFixture::setExpirationForkHeight(int targetMinusCurrent, int64_t preForkExpirationTime, int64_t postForkExpirationTime)
@@ -140,6 +144,17 @@ void ClaimTrieChainFixture::setHashForkHeight(int targetMinusCurrent)
     consensus.nAllClaimsInMerkleForkHeight = target;
 }
 
+void ClaimTrieChainFixture::enableHistory(int nDepth)
+{
+    base->nHistoryDepth = nDepth;
+    base->nHistoryStart = -1;
+}
+
+void ClaimTrieChainFixture::enableRanking()
+{
+    base->fRanking = true;
+}
+
 bool ClaimTrieChainFixture::CreateBlock(const std::unique_ptr<CBlockTemplate>& pblocktemplate)
 {
     CBlock* pblock = &pblocktemplate->block;
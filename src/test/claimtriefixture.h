@@ -64,6 +64,10 @@ struct ClaimTrieChainFixture: public CClaimTrieCache
 
     void setHashForkHeight(int targetMinusCurrent);
 
+    void enableHistory(int nDepth = 1000);
+
+    void enableRanking();
+
     bool CreateBlock(const std::unique_ptr<CBlockTemplate>& pblocktemplate);
 
     bool CreateCoinbases(unsigned int num_coinbases, std::vector<CTransaction>& coinbases);
@@ -121,6 +121,24 @@ BOOST_AUTO_TEST_CASE(hash_includes_all_claims_branched_test)
     }
 }
 
+// each node hashed on its own, straight from the definition
+static uint256 referenceNodeHash(const CClaimTrie::const_iterator& it)
+{
+    static const uint256 leafHash = uint256S("0000000000000000000000000000000000000000000000000000000000000002");
+    static const uint256 emptyHash = uint256S("0000000000000000000000000000000000000000000000000000000000000003");
+
+    std::vector<uint256> childHashes;
+    for (auto& child : it.children())
+        childHashes.push_back(referenceNodeHash(child));
+    std::vector<uint256> claimHashes;
+    for (auto& claim : it->claims)
+        claimHashes.push_back(getValueHash(claim.outPoint, it->nHeightOfLastTakeover));
+
+    auto left = childHashes.empty() ? leafHash : ComputeMerkleRoot(childHashes);
+    auto right = claimHashes.empty() ? emptyHash : ComputeMerkleRoot(claimHashes);
+    return Hash(left.begin(), left.end(), right.begin(), right.end());
+}
+
 BOOST_AUTO_TEST_CASE(hash_claims_children_fuzzer_test)
 {
     ClaimTrieChainFixture fixture;
@@ -154,6 +172,9 @@ BOOST_AUTO_TEST_CASE(hash_claims_children_fuzzer_test)
             ValidatePairs(fixture, proof.pairs, claimHash);
         }
     }
+
+    // the level at a time hashing agrees with hashing every node separately
+    BOOST_CHECK_EQUAL(referenceNodeHash(pclaimTrie->cbegin()), chainActive.Tip()->hashClaimTrie);
 }
 
 bool verify_proof(const CClaimTrieProof proof, uint256 rootHash, const std::string& name)
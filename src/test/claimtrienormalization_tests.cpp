@@ -52,6 +52,26 @@ BOOST_AUTO_TEST_CASE(normalization_only)
                           ccache.normalizeClaimName("\xEA\xBD\x91", true));
 }
 
+BOOST_AUTO_TEST_CASE(normalization_fast_path)
+{
+    // ascii doesn't go through ICU, it has to come out the same as if it did
+    std::string all;
+    for (int c = 0; c < 0x80; ++c) {
+        const std::string name(1, char(c));
+        BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName(name), CClaimTrieCache::normalizeUnicode(name));
+        all += name;
+    }
+    BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName(all), CClaimTrieCache::normalizeUnicode(all));
+    BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName("Some Longer NAME, Past Eight Bytes"), "some longer name, past eight bytes");
+
+    // a high bit in any position sends it to ICU, after a fast path miss the cached names are used
+    for (int i = 0; i < 3; ++i) {
+        BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName("ABCDEFGH\xD0\xA4"), "abcdefgh\xD1\x84");
+        BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName("\xD0\xA4" "ABCDEFGH"), "\xD1\x84" "abcdefgh");
+        BOOST_CHECK_EQUAL(CClaimTrieCache::normalizeName("ABCDEFGH\xFF"), "ABCDEFGH\xFF");
+    }
+}
+
 /*
     normalization
         check claim name normalization before the fork
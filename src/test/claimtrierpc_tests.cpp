@@ -2,7 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://opensource.org/licenses/mit-license.php
 
+#include <crypto/sha256.h>
+#include <index/claimhistoryindex.h>
 #include <test/claimtriefixture.h>
+#include <utiltime.h>
+
+#include <fstream>
 
 using namespace std;
 
@@ -34,6 +39,53 @@ BOOST_AUTO_TEST_CASE(getnamesintrie_test)
     BOOST_CHECK_EQUAL(results.size(), 0U);
 }
 
+BOOST_AUTO_TEST_CASE(getnamesintrie_paging_test)
+{
+    ClaimTrieChainFixture fixture;
+    for (auto name : {"a", "ab", "abc", "b", "ba", "c"})
+        fixture.MakeClaim(fixture.GetCoinbase(), name, "value", 1);
+    fixture.IncrementBlocks(1);
+    uint256 blockHash = chainActive.Tip()->GetBlockHash();
+    fixture.MakeClaim(fixture.GetCoinbase(), "aa", "value", 1);
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type getnamesintrie = tableRPC["getnamesintrie"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    auto all = getnamesintrie(req);
+    BOOST_REQUIRE_EQUAL(all.size(), 7U);
+
+    // page through them two at a time, at the tip and at the earlier block
+    for (auto& block : {UniValue(), UniValue(blockHash.GetHex())}) {
+        std::vector<std::string> names;
+        UniValue start;
+        for (;;) {
+            req.params = UniValue(UniValue::VARR);
+            req.params.push_back(block);
+            req.params.push_back(start);
+            req.params.push_back(2);
+            auto page = getnamesintrie(req);
+            BOOST_REQUIRE(page.size() <= 2U);
+            if (page.empty())
+                break;
+            for (std::size_t i = 0; i < page.size(); ++i)
+                names.push_back(page[i].get_str());
+            start = page[page.size() - 1];
+        }
+        auto expected = block.isNull()
+            ? std::vector<std::string>{"a", "aa", "ab", "abc", "b", "ba", "c"}
+            : std::vector<std::string>{"a", "ab", "abc", "b", "ba", "c"};
+        BOOST_CHECK(names == expected);
+    }
+
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(UniValue());
+    req.params.push_back("abc");
+    BOOST_CHECK_EQUAL(getnamesintrie(req).size(), 3U);
+    req.params.push_back(0);
+    BOOST_CHECK_THROW(getnamesintrie(req), UniValue);
+}
+
 BOOST_AUTO_TEST_CASE(getvalueforname_test)
 {
     ClaimTrieChainFixture fixture;
@@ -190,6 +242,113 @@ BOOST_AUTO_TEST_CASE(claim_rpcs_rollback3_test)
     BOOST_CHECK_EQUAL(valueResults[T_AMOUNT].get_int(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(claim_rpcs_history_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.enableHistory();
+    std::string sName1("test");
+
+    rpcfn_type getnamesintrie = tableRPC["getnamesintrie"]->actor;
+    rpcfn_type getclaimsforname = tableRPC["getclaimsforname"]->actor;
+    rpcfn_type getnameproof = tableRPC["getnameproof"]->actor;
+
+    auto query = [&](const uint256* blockHash) {
+        JSONRPCRequest req;
+        req.params = UniValue(UniValue::VARR);
+        if (blockHash)
+            req.params.push_back(blockHash->GetHex());
+        auto results = getnamesintrie(req).write();
+        req.params = UniValue(UniValue::VARR);
+        req.params.push_back(UniValue(sName1));
+        if (blockHash)
+            req.params.push_back(blockHash->GetHex());
+        return results + getclaimsforname(req).write() + getnameproof(req).write();
+    };
+
+    // the claim id index only knows the names of claims that still exist
+    auto withoutNames = [&sName1](std::string results) {
+        const std::string name = "\"name\":\"" + sName1 + "\",";
+        for (auto pos = results.find(name); pos != std::string::npos; pos = results.find(name))
+            results.erase(pos, name.size());
+        return results;
+    };
+
+    // what the tip looked like at every height
+    std::vector<std::pair<uint256, std::string>> expected;
+    auto snapshot = [&]() {
+        expected.emplace_back(chainActive.Tip()->GetBlockHash(), query(nullptr));
+    };
+    auto verify = [&]() {
+        for (auto& e : expected) {
+            CClaimTrieCache trieCache(pclaimTrie);
+            BOOST_CHECK(trieCache.loadHistory(LookupBlockIndex(e.first)));
+            BOOST_CHECK_EQUAL(withoutNames(query(&e.first)), withoutNames(e.second));
+        }
+    };
+
+    fixture.IncrementBlocks(1);
+    snapshot();
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, "one", 3);
+    fixture.IncrementBlocks(1);
+    snapshot();
+    CMutableTransaction tx2 = fixture.MakeClaim(fixture.GetCoinbase(), sName1 + "er", "two", 2);
+    fixture.IncrementBlocks(1);
+    snapshot();
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 5);
+    fixture.MakeClaim(fixture.GetCoinbase(), sName1, "three", 4);
+    fixture.IncrementBlocks(1);
+    snapshot();
+    fixture.Spend(tx1);
+    fixture.IncrementBlocks(1);
+    snapshot();
+    fixture.Spend(tx2);
+    fixture.IncrementBlocks(3);
+    snapshot();
+    verify();
+
+    // disconnected blocks take their history along
+    fixture.DecrementBlocks(4);
+    expected.resize(expected.size() - 2);
+    verify();
+    fixture.IncrementBlocks(2);
+    snapshot();
+    verify();
+}
+
+BOOST_AUTO_TEST_CASE(claim_rpcs_history_depth_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.enableHistory(2);
+    std::string sName1("test");
+
+    rpcfn_type getvalueforname = tableRPC["getvalueforname"]->actor;
+
+    auto valueAt = [&](const uint256& blockHash) {
+        JSONRPCRequest req;
+        req.params = UniValue(UniValue::VARR);
+        req.params.push_back(UniValue(sName1));
+        req.params.push_back(blockHash.GetHex());
+        return getvalueforname(req).write();
+    };
+
+    fixture.IncrementBlocks(1);
+    CMutableTransaction tx1 = fixture.MakeClaim(fixture.GetCoinbase(), sName1, "one", 3);
+    fixture.IncrementBlocks(1);
+    std::vector<std::pair<uint256, std::string>> expected;
+    for (int i = 0; i < 4; ++i) {
+        fixture.MakeSupport(fixture.GetCoinbase(), tx1, sName1, 1 + i);
+        fixture.IncrementBlocks(1);
+        expected.emplace_back(chainActive.Tip()->GetBlockHash(), valueAt(chainActive.Tip()->GetBlockHash()));
+    }
+
+    // only the last two blocks below the tip are looked up, the older ones are rolled back to
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        CClaimTrieCache trieCache(pclaimTrie);
+        BOOST_CHECK_EQUAL(trieCache.loadHistory(LookupBlockIndex(expected[i].first)), i + 3 >= expected.size());
+        BOOST_CHECK_EQUAL(valueAt(expected[i].first), expected[i].second);
+    }
+}
+
 std::vector<std::pair<bool, uint256>> jsonToPairs(const UniValue& jsonPair)
 {
     std::vector<std::pair<bool, uint256>> pairs;
@@ -404,4 +563,538 @@ BOOST_AUTO_TEST_CASE(claim_rpc_pending_amount_test)
     BOOST_CHECK(!claims[1].exists(T_PENDINGAMOUNT));
 }
 
+BOOST_AUTO_TEST_CASE(getclaimbyid_prefix_test)
+{
+    ClaimTrieChainFixture fixture;
+    std::vector<CMutableTransaction> txs;
+    for (int i = 0; i < 20; ++i)
+        txs.push_back(fixture.MakeClaim(fixture.GetCoinbase(), "test" + std::to_string(i % 4), "value", 1));
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type getclaimbyid = tableRPC["getclaimbyid"]->actor;
+    JSONRPCRequest req;
+
+    std::vector<std::string> claimIds;
+    for (auto& tx : txs) {
+        auto hex = ClaimIdHash(tx.GetHash(), 0).GetHex();
+        claimIds.push_back(hex);
+        // every claim is found by its own prefixes, odd lengths included
+        for (std::size_t length : {3, 4, 7, 12}) {
+            req.params = UniValue(UniValue::VARR);
+            req.params.push_back(hex.substr(0, length));
+            auto result = getclaimbyid(req);
+            BOOST_CHECK_EQUAL(result[T_CLAIMID].get_str().substr(0, length), hex.substr(0, length));
+        }
+        req.params = UniValue(UniValue::VARR);
+        req.params.push_back(hex);
+        BOOST_CHECK_EQUAL(getclaimbyid(req)[T_CLAIMID].get_str(), hex);
+    }
+
+    // a prefix no claim starts with
+    std::string unused;
+    for (int i = 0; unused.empty(); ++i) {
+        auto prefix = strprintf("%03x", i);
+        if (std::none_of(claimIds.begin(), claimIds.end(), [&prefix](const std::string& id) { return id.compare(0, 3, prefix) == 0; }))
+            unused = prefix;
+    }
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(unused);
+    BOOST_CHECK(getclaimbyid(req).empty());
+
+    // spent claims drop out of the index
+    fixture.Spend(txs[0]);
+    fixture.IncrementBlocks(1);
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(claimIds[0].substr(0, 10));
+    BOOST_CHECK(getclaimbyid(req).empty());
+}
+
+BOOST_AUTO_TEST_CASE(resolvenames_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    auto tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "two", 1);
+    fixture.MakeClaim(fixture.GetCoinbase(), "tester", "three", 1);
+    fixture.IncrementBlocks(1);
+    uint256 blockHash = chainActive.Tip()->GetBlockHash();
+    fixture.MakeClaim(fixture.GetCoinbase(), "other", "four", 1);
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type resolvenames = tableRPC["resolvenames"]->actor;
+    rpcfn_type getvalueforname = tableRPC["getvalueforname"]->actor;
+
+    auto claimId2 = ClaimIdHash(tx2.GetHash(), 0).GetHex();
+    UniValue names(UniValue::VARR);
+    names.push_back("tester");
+    names.push_back("test");
+    UniValue byId(UniValue::VOBJ);
+    byId.pushKV(T_NAME, "test");
+    byId.pushKV(T_CLAIMID, claimId2.substr(0, 8));
+    names.push_back(byId);
+    names.push_back("missing");
+    names.push_back("other");
+    names.push_back("test");
+
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(names);
+    auto results = resolvenames(req);
+    BOOST_REQUIRE_EQUAL(results.size(), names.size());
+
+    // the same as looking them up one at a time
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        JSONRPCRequest single;
+        single.params = UniValue(UniValue::VARR);
+        if (names[i].isStr()) {
+            single.params.push_back(names[i]);
+        } else {
+            single.params.push_back(names[i][T_NAME]);
+            single.params.push_back(chainActive.Tip()->GetBlockHash().GetHex());
+            single.params.push_back(names[i][T_CLAIMID]);
+        }
+        BOOST_CHECK_EQUAL(results[i].write(), getvalueforname(single).write());
+    }
+    BOOST_CHECK_EQUAL(results[0][T_VALUE].get_str(), HexStr(std::string("three")));
+    BOOST_CHECK_EQUAL(results[1][T_CLAIMID].get_str(), ClaimIdHash(tx1.GetHash(), 0).GetHex());
+    BOOST_CHECK_EQUAL(results[2][T_CLAIMID].get_str(), claimId2);
+    BOOST_CHECK(results[3].empty());
+
+    // and at an earlier block
+    req.params.push_back(blockHash.GetHex());
+    results = resolvenames(req);
+    BOOST_REQUIRE_EQUAL(results.size(), names.size());
+    BOOST_CHECK_EQUAL(results[1][T_VALUE].get_str(), HexStr(std::string("one")));
+    BOOST_CHECK(results[4].empty());
+}
+
+static void CheckViewMatches(const CClaimsForNameView& view, const CClaimSupportToName& expected)
+{
+    BOOST_CHECK_EQUAL(view.getName(), expected.name);
+    BOOST_CHECK_EQUAL(view.getLastTakeoverHeight(), expected.nLastTakeoverHeight);
+    BOOST_REQUIRE_EQUAL(view.size(), expected.claimsNsupports.size());
+    for (std::size_t i = 0; i < view.size(); ++i) {
+        auto& claimNsupports = expected.claimsNsupports[i];
+        BOOST_CHECK(view.claim(i) == claimNsupports.claim);
+        BOOST_CHECK_EQUAL(view.effectiveAmount(i), claimNsupports.effectiveAmount);
+        std::vector<CSupportValue> supports;
+        view.forEachSupport(i, [&supports](const CSupportValue& support) { supports.push_back(support); });
+        BOOST_CHECK(supports == claimNsupports.supports);
+        BOOST_CHECK_EQUAL(view.find(view.claim(i).claimId), i);
+        BOOST_CHECK_EQUAL(view.find(view.claim(i).claimId.GetHex().substr(0, 7)), i);
+    }
+    std::vector<CSupportValue> unmatched;
+    view.forEachUnmatchedSupport([&unmatched](const CSupportValue& support) { unmatched.push_back(support); });
+    BOOST_CHECK(unmatched == expected.unmatchedSupports);
+}
+
+BOOST_AUTO_TEST_CASE(claims_for_name_view_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 3);
+    auto tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "other", "two", 1);
+    fixture.IncrementBlocks(1);
+
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 2);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx2, "test", 4);
+    fixture.IncrementBlocks(10);
+
+    // a claim and a support that are still waiting in the queues
+    auto tx3 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "three", 1);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx3, "test", 1);
+    fixture.IncrementBlocks(1);
+
+    auto view = fixture.viewClaimsForName("test");
+    BOOST_REQUIRE_EQUAL(view.size(), 2U);
+    BOOST_CHECK_EQUAL(view.effectiveAmount(0), 5);
+    BOOST_CHECK_EQUAL(view.effectiveAmount(1), 0);
+    BOOST_CHECK_EQUAL(view.fullAmount(1), 2);
+    BOOST_CHECK(view.seqOrder() == std::vector<std::size_t>({0, 1}));
+    BOOST_CHECK_EQUAL(view.find(std::string("zz")), view.size());
+    CheckViewMatches(view, fixture.getClaimsForName("test"));
+    CheckViewMatches(pclaimTrie->getSnapshot()->viewClaimsForName("test"), fixture.getClaimsForName("test"));
+    BOOST_CHECK(fixture.viewClaimsForName("none").empty());
+}
+
+BOOST_AUTO_TEST_CASE(claim_trie_snapshot_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.setNormalizationForkHeight(1);
+    fixture.IncrementBlocks(2);
+
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "Test", "one", 2);
+    fixture.IncrementBlocks(1);
+    auto before = pclaimTrie->getSnapshot();
+
+    fixture.MakeClaim(fixture.GetCoinbase(), "test", "two", 3);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 5);
+    fixture.IncrementBlocks(1);
+    auto after = pclaimTrie->getSnapshot();
+    BOOST_CHECK_EQUAL(before->nNextHeight + 1, after->nNextHeight);
+
+    // the older snapshot keeps seeing the trie as it was
+    auto old = before->getClaimsForName("TEST");
+    BOOST_CHECK_EQUAL(old.name, "test");
+    BOOST_REQUIRE_EQUAL(old.claimsNsupports.size(), 1U);
+    BOOST_CHECK(old.claimsNsupports[0].supports.empty());
+    BOOST_CHECK_EQUAL(old.claimsNsupports[0].effectiveAmount, 2);
+
+    // and the current one agrees with the cache, including what's still pending
+    auto csToName = after->getClaimsForName("TEST");
+    auto expected = fixture.getClaimsForName("TEST");
+    BOOST_CHECK_EQUAL(csToName.name, expected.name);
+    BOOST_CHECK_EQUAL(csToName.nLastTakeoverHeight, expected.nLastTakeoverHeight);
+    BOOST_REQUIRE_EQUAL(csToName.claimsNsupports.size(), 2U);
+    BOOST_REQUIRE_EQUAL(csToName.claimsNsupports.size(), expected.claimsNsupports.size());
+    for (std::size_t i = 0; i < csToName.claimsNsupports.size(); ++i) {
+        BOOST_CHECK(csToName.claimsNsupports[i].claim == expected.claimsNsupports[i].claim);
+        BOOST_CHECK_EQUAL(csToName.claimsNsupports[i].effectiveAmount, expected.claimsNsupports[i].effectiveAmount);
+        BOOST_CHECK_EQUAL(csToName.claimsNsupports[i].supports.size(), expected.claimsNsupports[i].supports.size());
+    }
+    BOOST_CHECK_EQUAL(csToName.claimsNsupports[0].effectiveAmount, 7);
+
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK_EQUAL(pclaimTrie->getSnapshot()->getClaimsForName("test").claimsNsupports.size(), 1U);
+    BOOST_CHECK_EQUAL(after->getClaimsForName("test").claimsNsupports.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(claim_trie_snapshot_file_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    fixture.MakeClaim(fixture.GetCoinbase(), "tester", "two", 3);
+    fixture.IncrementBlocks(1);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 5);
+    fixture.MakeClaim(fixture.GetCoinbase(), "test", "three", 4);
+    fixture.IncrementBlocks(1);
+    const auto hash = fixture.getMerkleHash();
+
+    rpcfn_type dumpclaimtrie = tableRPC["dumpclaimtrie"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    const auto path = GetDataDir() / "claimtrie.snapshot";
+    req.params.push_back(path.string());
+    auto result = dumpclaimtrie(req);
+    BOOST_CHECK_EQUAL(result[T_HEIGHT].get_int(), chainActive.Height());
+    BOOST_CHECK_EQUAL(result[T_BLOCKHASH].get_str(), chainActive.Tip()->GetBlockHash().GetHex());
+    BOOST_CHECK_THROW(dumpclaimtrie(req), UniValue);
+
+    // it only fits the block it was taken at, and damaged copies are refused
+    const auto damaged = GetDataDir() / "damaged.snapshot";
+    fs::copy_file(path, damaged);
+    {
+        std::fstream file(damaged.string(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('x');
+    }
+    BOOST_CHECK(!fixture.loadSnapshot(damaged, chainActive.Tip()));
+    BOOST_CHECK(!fixture.loadSnapshot(path, chainActive.Tip()->pprev));
+    fs::remove(damaged);
+
+    // one cut short leaves a database that won't be read until a load goes through
+    const auto truncated = GetDataDir() / "truncated.snapshot";
+    {
+        std::ifstream in(path.string(), std::ios::binary);
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        data.resize(data.size() - CSHA256::OUTPUT_SIZE - 1);
+        unsigned char checksum[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(data.data(), data.size()).Finalize(checksum);
+        data.insert(data.end(), checksum, checksum + sizeof(checksum));
+        std::ofstream out(truncated.string(), std::ios::binary);
+        out.write((const char*)data.data(), data.size());
+    }
+    BOOST_CHECK(!fixture.loadSnapshot(truncated, chainActive.Tip()));
+    BOOST_CHECK(!fixture.ReadFromDisk(chainActive.Tip()));
+    BOOST_CHECK(fixture.needsSnapshot(path, chainActive.Tip()));
+    fs::remove(truncated);
+
+    BOOST_CHECK(fixture.loadSnapshot(path, chainActive.Tip()));
+    BOOST_CHECK_EQUAL(hash, fixture.getMerkleHash());
+    BOOST_CHECK(fixture.ReadFromDisk(chainActive.Tip()));
+    BOOST_CHECK(!fixture.needsSnapshot(path, chainActive.Tip()));
+    BOOST_CHECK(fixture.needsSnapshot(path, chainActive.Tip()->pprev));
+    auto csToName = fixture.getClaimsForName("test");
+    BOOST_REQUIRE_EQUAL(csToName.claimsNsupports.size(), 2U);
+    BOOST_CHECK_EQUAL(csToName.claimsNsupports[0].effectiveAmount, 7);
+    BOOST_CHECK_EQUAL(fixture.getClaimsForName("tester").claimsNsupports.size(), 1U);
+
+    // the chain carries on from it, past where the snapshot is loaded
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(!fixture.needsSnapshot(path, chainActive.Tip()));
+    fixture.DecrementBlocks(2);
+    BOOST_CHECK_EQUAL(fixture.getClaimsForName("test").claimsNsupports.size(), 1U);
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(getclaimhistory_test)
+{
+    ClaimTrieChainFixture fixture;
+    g_claimhistoryindex = MakeUnique<ClaimHistoryIndex>(1 << 20, true);
+    g_claimhistoryindex->Start();
+    int64_t time_start = GetTimeMillis();
+    while (!g_claimhistoryindex->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    auto claimId1 = ClaimIdHash(tx1.GetHash(), 0);
+    fixture.IncrementBlocks(1);
+    int nClaimHeight = chainActive.Height();
+    auto s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(1);
+    auto u1 = fixture.MakeUpdate(tx1, "test", "two", claimId1, 2);
+    fixture.IncrementBlocks(1);
+    int nUpdateHeight = chainActive.Height();
+    fixture.Spend(s1);
+    fixture.IncrementBlocks(1);
+    fixture.Spend(u1);
+    // an update that doesn't spend the claim is no update
+    fixture.MakeUpdate(fixture.GetCoinbase(), "test", "three", claimId1, 1);
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type getclaimhistory = tableRPC["getclaimhistory"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(claimId1.GetHex());
+    auto events = getclaimhistory(req);
+    BOOST_REQUIRE_EQUAL(events.size(), 5U);
+    const char* types[] = { "claim", "support", "update", "abandonsupport", "abandon" };
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        BOOST_CHECK_EQUAL(events[i][T_EVENT].get_str(), types[i]);
+        BOOST_CHECK_EQUAL(events[i][T_HEIGHT].get_int(), nClaimHeight + int(i));
+        BOOST_CHECK_EQUAL(events[i][T_NAME].get_str(), "test");
+    }
+    BOOST_CHECK_EQUAL(events[0][T_VALUE].get_str(), HexStr(std::string("one")));
+    BOOST_CHECK_EQUAL(events[1][T_TXID].get_str(), s1.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(events[1][T_AMOUNT].get_int(), 1);
+    BOOST_CHECK_EQUAL(events[2][T_VALUE].get_str(), HexStr(std::string("two")));
+    BOOST_CHECK_EQUAL(events[2][T_TXID].get_str(), u1.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(events[4][T_TXID].get_str(), u1.GetHash().GetHex());
+
+    // pages
+    req.params.push_back(UniValue());
+    req.params.push_back(2);
+    events = getclaimhistory(req);
+    BOOST_REQUIRE_EQUAL(events.size(), 2U);
+    BOOST_CHECK_EQUAL(events[1][T_EVENT].get_str(), "support");
+    req.params.setArray();
+    req.params.push_back(claimId1.GetHex());
+    req.params.push_back(nUpdateHeight);
+    events = getclaimhistory(req);
+    BOOST_REQUIRE_EQUAL(events.size(), 3U);
+    BOOST_CHECK_EQUAL(events[0][T_EVENT].get_str(), "update");
+
+    // a disconnected block is no longer part of the history
+    fixture.DecrementBlocks(1);
+    req.params.setArray();
+    req.params.push_back(claimId1.GetHex());
+    events = getclaimhistory(req);
+    BOOST_REQUIRE_EQUAL(events.size(), 4U);
+    BOOST_CHECK_EQUAL(events[3][T_EVENT].get_str(), "abandonsupport");
+
+    g_claimhistoryindex->Stop();
+    g_claimhistoryindex.reset();
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(getclaimhistory_expired_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.setExpirationForkHeight(1000, 20, 40);
+    g_claimhistoryindex = MakeUnique<ClaimHistoryIndex>(1 << 20, true);
+    g_claimhistoryindex->Start();
+
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    auto claimId1 = ClaimIdHash(tx1.GetHash(), 0);
+    auto s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(21);
+    BOOST_CHECK(!pclaimTrie->find("test"));
+
+    // the claim trie ignores the update of an expired claim, so does the history
+    fixture.MakeUpdate(tx1, "test", "two", claimId1, 2);
+    fixture.Spend(s1);
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK(!pclaimTrie->find("test"));
+
+    int64_t time_start = GetTimeMillis();
+    while (!g_claimhistoryindex->BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+    rpcfn_type getclaimhistory = tableRPC["getclaimhistory"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(claimId1.GetHex());
+    auto events = getclaimhistory(req);
+    BOOST_REQUIRE_EQUAL(events.size(), 2U);
+    BOOST_CHECK_EQUAL(events[0][T_EVENT].get_str(), "claim");
+    BOOST_CHECK_EQUAL(events[1][T_EVENT].get_str(), "support");
+
+    g_claimhistoryindex->Stop();
+    g_claimhistoryindex.reset();
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(getsupportsbyclaimid_test)
+{
+    ClaimTrieChainFixture fixture;
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    auto claimId1 = ClaimIdHash(tx1.GetHash(), 0);
+    auto tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "other", "two", 3);
+    fixture.IncrementBlocks(1);
+    auto s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    // a support under another name is found as well
+    auto s2 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "other", 4);
+    fixture.MakeSupport(fixture.GetCoinbase(), tx2, "other", 5);
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type getsupportsbyclaimid = tableRPC["getsupportsbyclaimid"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(claimId1.GetHex());
+    auto supports = getsupportsbyclaimid(req);
+    // the support of a claim that doesn't control its name waits in the queue like any other
+    BOOST_REQUIRE_EQUAL(supports.size(), 1U);
+    BOOST_CHECK_EQUAL(supports[0][T_TXID].get_str(), s1.GetHash().GetHex());
+    fixture.IncrementBlocks(1);
+    supports = getsupportsbyclaimid(req);
+    BOOST_REQUIRE_EQUAL(supports.size(), 2U);
+    auto i1 = supports[0][T_TXID].get_str() == s1.GetHash().GetHex() ? 0 : 1;
+    BOOST_CHECK_EQUAL(supports[i1][T_TXID].get_str(), s1.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(supports[i1][T_NAME].get_str(), "test");
+    BOOST_CHECK_EQUAL(supports[i1][T_AMOUNT].get_int(), 1);
+    BOOST_CHECK_EQUAL(supports[1 - i1][T_TXID].get_str(), s2.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(supports[1 - i1][T_NAME].get_str(), "other");
+    BOOST_CHECK_EQUAL(supports[1 - i1][T_AMOUNT].get_int(), 4);
+
+    // spent supports go and come back when their spend is disconnected
+    fixture.Spend(s1);
+    fixture.IncrementBlocks(1);
+    supports = getsupportsbyclaimid(req);
+    BOOST_REQUIRE_EQUAL(supports.size(), 1U);
+    BOOST_CHECK_EQUAL(supports[0][T_TXID].get_str(), s2.GetHash().GetHex());
+    fixture.DecrementBlocks(1);
+    BOOST_CHECK_EQUAL(getsupportsbyclaimid(req).size(), 2U);
+    fixture.DecrementBlocks(2);
+    BOOST_CHECK_EQUAL(getsupportsbyclaimid(req).size(), 0U);
+
+    req.params.setArray();
+    req.params.push_back(claimId1.GetHex().substr(0, 10));
+    BOOST_CHECK_THROW(getsupportsbyclaimid(req), UniValue);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(gettopclaims_test)
+{
+    ClaimTrieChainFixture fixture;
+    rpcfn_type gettopclaims = tableRPC["gettopclaims"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    BOOST_CHECK_THROW(gettopclaims(req), UniValue);
+
+    fixture.enableRanking();
+    fixture.MakeClaim(fixture.GetCoinbase(), "a", "one", 5);
+    auto tx2 = fixture.MakeClaim(fixture.GetCoinbase(), "b", "two", 3);
+    auto tx3 = fixture.MakeClaim(fixture.GetCoinbase(), "c", "three", 7);
+    fixture.IncrementBlocks(1);
+
+    auto checkTop = [&](const std::vector<std::string>& names) {
+        auto top = gettopclaims(req);
+        BOOST_REQUIRE_EQUAL(top.size(), names.size());
+        for (std::size_t i = 0; i < names.size(); ++i)
+            BOOST_CHECK_EQUAL(top[i][T_NORMALIZEDNAME].get_str(), names[i]);
+        return top;
+    };
+    auto top = checkTop({"c", "a", "b"});
+    BOOST_CHECK_EQUAL(top[0][T_CLAIMID].get_str(), ClaimIdHash(tx3.GetHash(), 0).GetHex());
+    BOOST_CHECK_EQUAL(top[0][T_EFFECTIVEAMOUNT].get_int(), 7);
+
+    // a support alone moves a claim up
+    fixture.MakeSupport(fixture.GetCoinbase(), tx2, "b", 10);
+    fixture.IncrementBlocks(1);
+    top = checkTop({"b", "c", "a"});
+    BOOST_CHECK_EQUAL(top[0][T_AMOUNT].get_int(), 3);
+    BOOST_CHECK_EQUAL(top[0][T_EFFECTIVEAMOUNT].get_int(), 13);
+
+    // pages
+    req.params.push_back(1);
+    req.params.push_back(1);
+    checkTop({"c"});
+    req.params.setArray();
+
+    fixture.Spend(tx3);
+    fixture.IncrementBlocks(1);
+    checkTop({"b", "a"});
+
+    fixture.DecrementBlocks(1);
+    checkTop({"b", "c", "a"});
+    fixture.DecrementBlocks(1);
+    top = checkTop({"c", "a", "b"});
+    BOOST_CHECK_EQUAL(top[2][T_EFFECTIVEAMOUNT].get_int(), 3);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(getexpiringclaims_test)
+{
+    ClaimTrieChainFixture fixture;
+    fixture.setExpirationForkHeight(1000, 20, 40);
+    auto tx1 = fixture.MakeClaim(fixture.GetCoinbase(), "test", "one", 2);
+    auto s1 = fixture.MakeSupport(fixture.GetCoinbase(), tx1, "test", 1);
+    fixture.IncrementBlocks(1);
+    int nExpirationHeight = chainActive.Height() + 20;
+    fixture.MakeClaim(fixture.GetCoinbase(), "later", "two", 1);
+    fixture.IncrementBlocks(1);
+
+    rpcfn_type getexpiringclaims = tableRPC["getexpiringclaims"]->actor;
+    JSONRPCRequest req;
+    req.params = UniValue(UniValue::VARR);
+    req.params.push_back(nExpirationHeight);
+    auto expiring = getexpiringclaims(req);
+    BOOST_REQUIRE_EQUAL(expiring.size(), 2U);
+    BOOST_CHECK_EQUAL(expiring[0][T_CLAIMTYPE].get_str(), "claim");
+    BOOST_CHECK_EQUAL(expiring[0][T_NAME].get_str(), "test");
+    BOOST_CHECK_EQUAL(expiring[0][T_CLAIMID].get_str(), ClaimIdHash(tx1.GetHash(), 0).GetHex());
+    BOOST_CHECK_EQUAL(expiring[0][T_TXID].get_str(), tx1.GetHash().GetHex());
+    BOOST_CHECK_EQUAL(expiring[0][T_AMOUNT].get_int(), 2);
+    BOOST_CHECK_EQUAL(expiring[0][T_EXPIRATIONHEIGHT].get_int(), nExpirationHeight);
+    BOOST_CHECK_EQUAL(expiring[1][T_CLAIMTYPE].get_str(), "support");
+    BOOST_CHECK_EQUAL(expiring[1][T_CLAIMID].get_str(), ClaimIdHash(tx1.GetHash(), 0).GetHex());
+    BOOST_CHECK_EQUAL(expiring[1][T_TXID].get_str(), s1.GetHash().GetHex());
+
+    // a window, in the order of the heights
+    req.params.setArray();
+    req.params.push_back(0);
+    req.params.push_back(nExpirationHeight + 100);
+    expiring = getexpiringclaims(req);
+    BOOST_REQUIRE_EQUAL(expiring.size(), 3U);
+    BOOST_CHECK_EQUAL(expiring[2][T_NAME].get_str(), "later");
+    BOOST_CHECK_EQUAL(expiring[2][T_EXPIRATIONHEIGHT].get_int(), nExpirationHeight + 1);
+
+    // what is spent or has expired is no longer in the queue
+    fixture.Spend(s1);
+    fixture.IncrementBlocks(1);
+    BOOST_CHECK_EQUAL(getexpiringclaims(req).size(), 2U);
+    fixture.IncrementBlocks(nExpirationHeight - chainActive.Height());
+    BOOST_CHECK(!pclaimTrie->find("test"));
+    BOOST_CHECK_EQUAL(getexpiringclaims(req).size(), 1U);
+
+    req.params.setArray();
+    req.params.push_back(nExpirationHeight + 1);
+    req.params.push_back(nExpirationHeight);
+    BOOST_CHECK_THROW(getexpiringclaims(req), UniValue);
+
+    // the window is capped, the heights that can't have rows don't count
+    req.params.setArray();
+    req.params.push_back(chainActive.Height() + 1);
+    req.params.push_back(chainActive.Height() + 20000);
+    BOOST_CHECK_NO_THROW(getexpiringclaims(req));
+    fixture.setExpirationForkHeight(1000, 20000, 20000);
+    BOOST_CHECK_THROW(getexpiringclaims(req), UniValue);
+    req.params.setArray();
+    req.params.push_back(chainActive.Height() + 1);
+    req.params.push_back(chainActive.Height() + 10000);
+    BOOST_CHECK_NO_THROW(getexpiringclaims(req));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
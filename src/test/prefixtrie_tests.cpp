@@ -1,4 +1,5 @@
 #include <claimtrie.h>
+#include <lbry.h>
 #include <prefixtrie.h>
 #include <random.h>
 
@@ -7,6 +8,7 @@
 #include <test/test_bitcoin.h>
 
 #include <chrono>
+#include <thread>
 
 std::vector<std::string> random_strings(std::size_t count)
 {
@@ -240,6 +242,146 @@ BOOST_AUTO_TEST_CASE(erase_cleanup_test)
     BOOST_CHECK_EQUAL(root.height(), 2);
 }
 
+BOOST_AUTO_TEST_CASE(path_compression_test)
+{
+    CPrefixTrie<std::string, CClaimTrieData> root;
+
+    CClaimTrieData data;
+    data.insertClaim(CClaimValue{});
+    BOOST_CHECK(root.insert("abcdefgh", data) != root.end());
+    // a single name is a single node hanging off the root
+    BOOST_CHECK_EQUAL(root.height(), 1);
+    BOOST_CHECK_EQUAL(root.nodes("abcdefgh").size(), 2);
+    BOOST_CHECK(root.find("abcd") == root.end());
+
+    BOOST_CHECK(root.insert("abcdxyz", data) != root.end());
+    BOOST_CHECK_EQUAL(root.height(), 3);
+    auto nodes = root.nodes("abcdxyz");
+    BOOST_REQUIRE_EQUAL(nodes.size(), 3);
+    BOOST_CHECK_EQUAL(nodes[1].key(), "abcd");
+    BOOST_CHECK(nodes[1]->empty());
+    BOOST_CHECK_EQUAL(nodes[2].key(), "abcdxyz");
+
+    // keys diverging before the end of an edge are not found
+    BOOST_CHECK(root.find("abcdx") == root.end());
+    BOOST_CHECK(root.find("abcdxyzz") == root.end());
+    BOOST_CHECK(root.find("abce") == root.end());
+
+    BOOST_CHECK(root.erase("abcdxyz"));
+    BOOST_CHECK_EQUAL(root.height(), 1);
+    BOOST_CHECK(root.find("abcd") == root.end());
+    BOOST_CHECK(root.find("abcdefgh") != root.end());
+
+    // bytes above 0x7f must sort the same way on insert and on lookup
+    const std::vector<std::string> names = {"\xc3\xa9t\xc3\xa9", "\xc3\xa9", "e", "\xff", "\x01\xff", "z"};
+    for (auto& name : names)
+        BOOST_CHECK(root.insert(name, data) != root.end());
+    for (auto& name : names)
+        BOOST_CHECK(root.find(name) != root.end());
+    BOOST_CHECK_EQUAL(root.height(), 1 + names.size());
+}
+
+BOOST_AUTO_TEST_CASE(stale_iterator_test)
+{
+    CPrefixTrie<std::string, CClaimTrieData> root;
+
+    CClaimTrieData data;
+    data.insertClaim(CClaimValue{});
+    BOOST_CHECK(root.insert("abc", data) != root.end());
+    BOOST_CHECK(root.insert("abd", data) != root.end());
+
+    auto nodes = root.nodes("abd");
+    BOOST_REQUIRE_EQUAL(nodes.size(), 3);
+    BOOST_CHECK(root.erase("abd"));
+
+    // the erased leaf and the collapsed "ab" are gone, the root is not
+    BOOST_CHECK(nodes[0]);
+    BOOST_CHECK(!nodes[1]);
+    BOOST_CHECK(!nodes[2]);
+    BOOST_CHECK(nodes[2] == root.end());
+
+    // reusing the released slots does not revive the old iterators
+    BOOST_CHECK(root.insert("xyz", data) != root.end());
+    BOOST_CHECK(root.insert("xyw", data) != root.end());
+    BOOST_CHECK(!nodes[1]);
+    BOOST_CHECK(!nodes[2]);
+
+    auto it = root.find("abc");
+    BOOST_CHECK(it);
+    root.clear();
+    BOOST_CHECK(!it);
+    BOOST_CHECK(root.empty());
+}
+
+BOOST_AUTO_TEST_CASE(lower_bound_test)
+{
+    CPrefixTrie<std::string, CClaimTrieData> root;
+    BOOST_CHECK(root.lower_bound("a") == root.end());
+
+    CClaimTrieData data;
+    data.insertClaim(CClaimValue{});
+    auto names = random_strings(2000);
+    for (auto name : {"", "\x7f", "\x80", "a\xff", "a\xff" "b", "zzzz"})
+        names.push_back(name);
+    for (auto& name : names)
+        BOOST_CHECK(root.insert(name, data) != root.end());
+
+    // iterating goes in key order
+    std::vector<std::string> keys;
+    for (auto it = root.begin(); it != root.end(); ++it)
+        keys.push_back(it.key());
+    BOOST_REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+
+    auto probes = random_strings(500);
+    for (auto& name : names) {
+        probes.push_back(name);
+        probes.push_back(name + '\0');
+        probes.push_back(name.substr(0, name.size() / 2));
+    }
+    probes.push_back("\xff");
+    for (auto& probe : probes) {
+        auto expected = std::lower_bound(keys.begin(), keys.end(), probe);
+        auto it = root.lower_bound(probe);
+        // and it carries on from there as if it had started at the beginning
+        for (int i = 0; i < 3 && expected != keys.end(); ++i, ++expected, ++it) {
+            BOOST_REQUIRE(it != root.end());
+            BOOST_CHECK_EQUAL(it.key(), *expected);
+        }
+        if (expected == keys.end())
+            BOOST_CHECK(it == root.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(memfile_threads_test)
+{
+    // the slabs of tries built on different threads come out of the one -memfile segment
+    g_memfileSize = 1;
+    auto names = random_strings(20000);
+    std::vector<std::thread> threads;
+    std::vector<char> found(4, false);
+    for (std::size_t t = 0; t < found.size(); ++t) {
+        threads.emplace_back([&names, &found, t]() {
+            bool ok = true;
+            for (int round = 0; round < 3; ++round) {
+                CPrefixTrie<std::string, CClaimTrieData> trie;
+                for (std::size_t i = 0; i < names.size(); ++i) {
+                    CClaimTrieData data;
+                    data.nHeightOfLastTakeover = int(i + t);
+                    trie.insert(names[i], std::move(data));
+                }
+                for (std::size_t i = 0; i < names.size(); ++i)
+                    ok = ok && trie.at(names[i]).nHeightOfLastTakeover == int(i + t);
+            }
+            found[t] = ok;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    g_memfileSize = 0;
+    for (char ok : found)
+        BOOST_CHECK(ok);
+}
+
 BOOST_AUTO_TEST_CASE(add_many_nodes) {
     // this if for testing performance and making sure erasure goes all the way to zero
     CPrefixTrie<std::string, CClaimTrieData> trie;
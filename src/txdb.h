@@ -39,6 +39,10 @@ static const int64_t nMaxBlockDBCache = 4;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to claim index DB specific cache, if -claimindex (MiB)
+static const int64_t nMaxClaimIndexCache = 256;
+//! Max memory allocated to claim history index DB specific cache, if -claimhistoryindex (MiB)
+static const int64_t nMaxClaimHistoryIndexCache = 256;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -79,6 +79,7 @@ size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
+bool fClaimTrieChanges = false;
 
 uint256 hashAssumeValid;
 arith_uint256 nMinimumChainWork;
@@ -1481,11 +1482,13 @@ int ApplyTxInUndo(unsigned int index, CTxUndo& txUndo, CCoinsViewCache& view, CC
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CClaimTrieCache& trieCache)
+ *  When FAILED is returned, view is left in an indeterminate state.
+ *  Without fCheckClaimHash the claim trie hash is left to the caller, to check once after several blocks.
+ *  The undo data is read from disk unless the caller already has it in pblockundo, which is used up. */
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CClaimTrieCache& trieCache, bool fCheckClaimHash, CBlockUndo* pblockundo)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
-    if (pindex->hashClaimTrie != trieCache.getMerkleHash()) {
+    if (fCheckClaimHash && pindex->hashClaimTrie != trieCache.getMerkleHash()) {
         LogPrintf("%s: Indexed claim hash doesn't match current: %s vs %s\n",
                 __func__, pindex->hashClaimTrie.ToString(), trieCache.getMerkleHash().ToString());
         assert(false);
@@ -1493,11 +1496,12 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
+    CBlockUndo blockUndoRead;
+    if (!pblockundo && !UndoReadFromDisk(blockUndoRead, pindex)) {
         error("DisconnectBlock(): failure reading undo data");
         return DISCONNECT_FAILED;
     }
+    CBlockUndo& blockUndo = pblockundo ? *pblockundo : blockUndoRead;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("DisconnectBlock(): block and undo data inconsistent");
@@ -1560,6 +1564,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
     assert(trieCache.finalizeDecrement(blockUndo.takeoverHeightUndo));
+    if (!fCheckClaimHash)
+        return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
     auto merkleHash = trieCache.getMerkleHash();
     if (merkleHash != pindex->pprev->hashClaimTrie) {
         if (!trieCache.empty())
@@ -1739,9 +1745,10 @@ static int64_t nBlocksTotal = 0;
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  The undo data the block was connected with is handed back in pblockundo when it is given. */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, CClaimTrieCache& trieCache, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, CClaimTrieCache& trieCache, const CChainParams& chainparams, bool fJustCheck, CBlockUndo* pblockundo)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1934,6 +1941,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     trieCache.initializeIncrement();
 
+    // the database rows the block's claims need are read on the claim trie threads while its scripts are checked
+    auto prefetch = trieCache.prefetch(ClaimNamesInBlock(block, trieCache, view));
+
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
@@ -2034,6 +2044,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
+    prefetch->Wait();
+
     // TODO: if the "just check" flag is set, we should reduce the work done here. Incrementing blocks twice per mine is not efficient.
     const auto incremented = trieCache.incrementBlock(blockundo.insertUndo, blockundo.expireUndo, blockundo.insertSupportUndo, blockundo.expireSupportUndo, blockundo.takeoverHeightUndo);
     assert(incremented);
@@ -2085,6 +2097,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
+    if (pblockundo)
+        *pblockundo = std::move(blockundo);
     return true;
 }
 
@@ -2184,7 +2198,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            if (mode == FlushStateMode::ALWAYS && !pclaimTrie->SyncToDisk())
+            // the claim trie writes kept since the last flush go first, the claim trie is never behind the coins
+            if (!(mode == FlushStateMode::ALWAYS ? pclaimTrie->SyncToDisk() : pclaimTrie->writePending()))
                 return state.Error("Failed to write to claim trie database");
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
@@ -2301,6 +2316,53 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
     }
 }
 
+/**
+ * Names whose claims or supports a block changes: those in its outputs, in the outputs it spends
+ * and in its claim undo data, taken from the undo data ConnectBlock made or DisconnectBlock uses.
+ */
+static void ClaimTrieNamesInBlock(const CBlock& block, const CBlockUndo& blockUndo, const CClaimTrieCache& trieCache, std::set<std::string>& names)
+{
+    const auto addName = [&names, &trieCache](const CScript& scriptPubKey) {
+        int op;
+        std::vector<std::vector<unsigned char>> vvchParams;
+        if (DecodeClaimScript(scriptPubKey, op, vvchParams, trieCache.allowSupportMetadata()))
+            names.emplace(vvchParams[0].begin(), vvchParams[0].end());
+    };
+    for (auto& tx : block.vtx)
+        for (auto& txout : tx->vout)
+            addName(txout.scriptPubKey);
+    for (auto& txUndo : blockUndo.vtxundo)
+        for (auto& coin : txUndo.vprevout)
+            addName(coin.txout.scriptPubKey);
+
+    for (auto& entry : blockUndo.insertUndo)
+        names.insert(entry.name);
+    for (auto& entry : blockUndo.expireUndo)
+        names.insert(entry.first);
+    for (auto& entry : blockUndo.insertSupportUndo)
+        names.insert(entry.name);
+    for (auto& entry : blockUndo.expireSupportUndo)
+        names.insert(entry.first);
+    for (auto& entry : blockUndo.takeoverHeightUndo)
+        names.insert(entry.first);
+}
+
+/** The claim trie changes of the block at pindex given the claims of its names once it is connected, see AppendClaimTrieChanges */
+static std::shared_ptr<const CClaimTrieBlockChanges> ClaimTrieChangesInBlock(const CBlockIndex* pindex, bool fConnected,
+    const std::vector<CClaimSupportToName>& connected, const CClaimTrieCache& disconnected)
+{
+    auto changes = std::make_shared<CClaimTrieBlockChanges>();
+    changes->hashBlock = pindex->GetBlockHash();
+    changes->nHeight = pindex->nHeight;
+    changes->fConnected = fConnected;
+    // different spellings of a name normalize to the same one
+    std::set<std::string> seen;
+    for (auto& after : connected)
+        if (seen.insert(after.name).second)
+            AppendClaimTrieChanges(changes->changes, disconnected.getClaimsForName(after.name), after, pindex->nHeight);
+    return changes;
+}
+
 /** Disconnect chainActive's tip.
   * After calling, the mempool will be in an inconsistent state, with
   * transactions from disconnected blocks being added to disconnectpool.  You
@@ -2315,19 +2377,15 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return AbortNode(state, "Failed to read block");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    DisconnectedTip tip;
+    tip.pindex = pindexDelete;
     {
         CCoinsViewCache view(pcoinsTip.get());
         CClaimTrieCache trieCache(pclaimTrie);
-        assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view, trieCache) != DISCONNECT_OK)
-            return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        if (!DisconnectTipBlock(state, chainparams, view, trieCache, true, tip))
+            return false;
         bool flushed = view.Flush();
         assert(flushed);
         assert(trieCache.flush());
@@ -2338,9 +2396,47 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
 
+    FinishDisconnectTip(chainparams, tip, disconnectpool);
+    return true;
+}
+
+/**
+ * Disconnect the block at tip.pindex, which view and trieCache are at, into them and fill in the rest of tip.
+ * The chain itself is left as it is until the caches are flushed and FinishDisconnectTip is called.
+ * Without fCheckClaimHash the claim trie hash is left to the caller, see DisconnectBlock.
+ */
+bool CChainState::DisconnectTipBlock(CValidationState& state, const CChainParams& chainparams, CCoinsViewCache& view, CClaimTrieCache& trieCache, bool fCheckClaimHash, DisconnectedTip& tip)
+{
+    // Read block from disk.
+    tip.pblock = std::make_shared<CBlock>();
+    CBlock& block = *tip.pblock;
+    if (!ReadBlockFromDisk(block, tip.pindex, chainparams.GetConsensus()))
+        return AbortNode(state, "Failed to read block");
+    assert(view.GetBestBlock() == tip.pindex->GetBlockHash());
+    // the undo data is read once here for both the changes and DisconnectBlock
+    CBlockUndo blockUndo;
+    std::vector<CClaimSupportToName> connected;
+    const bool fChanges = fClaimTrieChanges && UndoReadFromDisk(blockUndo, tip.pindex);
+    if (fChanges) {
+        std::set<std::string> names;
+        ClaimTrieNamesInBlock(block, blockUndo, trieCache, names);
+        for (auto& name : names)
+            connected.push_back(trieCache.getClaimsForName(name));
+    }
+    if (DisconnectBlock(block, tip.pindex, view, trieCache, fCheckClaimHash, fChanges ? &blockUndo : nullptr) != DISCONNECT_OK)
+        return error("DisconnectTip(): DisconnectBlock %s failed", tip.pindex->GetBlockHash().ToString());
+    if (fChanges)
+        tip.claimTrieChanges = ClaimTrieChangesInBlock(tip.pindex, false, connected, trieCache);
+    return true;
+}
+
+/** Move the chain back past a block disconnected by DisconnectTipBlock once its caches are flushed, and announce it */
+void CChainState::FinishDisconnectTip(const CChainParams& chainparams, const DisconnectedTip& tip, DisconnectedBlockTransactions *disconnectpool)
+{
+    assert(chainActive.Tip() == tip.pindex);
     if (disconnectpool) {
         // Save transactions to re-add to mempool at end of reorg
-        for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
+        for (auto it = tip.pblock->vtx.rbegin(); it != tip.pblock->vtx.rend(); ++it) {
             disconnectpool->addTransaction(*it);
         }
         while (disconnectpool->DynamicMemoryUsage() > MAX_DISCONNECTED_TX_POOL_SIZE * 1000) {
@@ -2351,12 +2447,54 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         }
     }
 
-    chainActive.SetTip(pindexDelete->pprev);
+    chainActive.SetTip(tip.pindex->pprev);
 
-    UpdateTip(pindexDelete->pprev, chainparams);
+    UpdateTip(tip.pindex->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    GetMainSignals().BlockDisconnected(pblock);
+    GetMainSignals().BlockDisconnected(tip.pblock);
+    if (tip.claimTrieChanges)
+        GetMainSignals().ClaimTrieChanged(tip.claimTrieChanges);
+}
+
+/**
+ * Disconnect blocks from the tip down to pindexFork. The claim trie changes of all of them
+ * are kept in one cache, hashed and flushed once at the end instead of after every block,
+ * and so are the coins, so that neither gets ahead of the other. Only once both caches are
+ * flushed does the tip move and are the blocks announced and their transactions queued for
+ * the mempool. When the coins cache grows past -dbcache the blocks disconnected so far are
+ * flushed and finished that way and the rest goes on in new caches.
+ * If a block fails to disconnect the caches are dropped and the tip stays at the last flushed block.
+ */
+bool CChainState::DisconnectTipsTo(CValidationState& state, const CChainParams& chainparams, const CBlockIndex* pindexFork, DisconnectedBlockTransactions *disconnectpool)
+{
+    int64_t nStart = GetTimeMicros();
+    const int nDisconnectFrom = chainActive.Height();
+    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+        std::vector<DisconnectedTip> disconnected;
+        {
+            CCoinsViewCache coinsCache(pcoinsTip.get());
+            CClaimTrieCache trieCache(pclaimTrie);
+            const size_t nTipMemoryUsage = pcoinsTip->DynamicMemoryUsage();
+            for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork; pindex = pindex->pprev) {
+                disconnected.emplace_back();
+                disconnected.back().pindex = pindex;
+                if (!DisconnectTipBlock(state, chainparams, coinsCache, trieCache, false, disconnected.back()))
+                    return false;
+                if (coinsCache.DynamicMemoryUsage() + nTipMemoryUsage > nCoinCacheUsage)
+                    break;
+            }
+            bool flushed = coinsCache.Flush();
+            assert(flushed);
+            assert(trieCache.flush());
+            assert(disconnected.back().pindex->pprev->hashClaimTrie == trieCache.getMerkleHash());
+        }
+        for (auto& tip : disconnected)
+            FinishDisconnectTip(chainparams, tip, disconnectpool);
+        if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
+            return false;
+    }
+    LogPrint(BCLog::BENCH, "- Disconnect %d blocks: %.2fms\n", nDisconnectFrom - chainActive.Height(), (GetTimeMicros() - nStart) * MILLI);
     return true;
 }
 
@@ -2456,10 +2594,14 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    std::shared_ptr<const CClaimTrieBlockChanges> claimTrieChanges;
     {
         CCoinsViewCache view(pcoinsTip.get());
+        // while catching up the claim trie database is written out along with the coins
+        pclaimTrie->setWriteBuffer(IsInitialBlockDownload() ? nClaimTrieWriteBuffer : 0);
         CClaimTrieCache trieCache(pclaimTrie);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, trieCache, chainparams);
+        CBlockUndo blockUndo;
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, trieCache, chainparams, false, fClaimTrieChanges ? &blockUndo : nullptr);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2468,6 +2610,15 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        if (fClaimTrieChanges) {
+            // the claim trie itself is still as it was before the block until the cache is flushed
+            std::set<std::string> names;
+            ClaimTrieNamesInBlock(blockConnecting, blockUndo, trieCache, names);
+            std::vector<CClaimSupportToName> connected;
+            for (auto& name : names)
+                connected.push_back(trieCache.getClaimsForName(name));
+            claimTrieChanges = ClaimTrieChangesInBlock(pindexNew, true, connected, CClaimTrieCache(pclaimTrie));
+        }
         bool flushed = view.Flush();
         assert(flushed);
         flushed = trieCache.flush();
@@ -2492,6 +2643,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
+    if (claimTrieChanges)
+        GetMainSignals().ClaimTrieChanged(claimTrieChanges);
     return true;
 }
 
@@ -2579,8 +2732,8 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
     DisconnectedBlockTransactions disconnectpool;
-    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+    if (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+        if (!DisconnectTipsTo(state, chainparams, pindexFork, &disconnectpool)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(disconnectpool, false);
@@ -2836,11 +2989,11 @@ bool CChainState::InvalidateBlock(CValidationState& state, const CChainParams& c
     CBlockIndex *invalid_walk_tip = chainActive.Tip();
 
     DisconnectedBlockTransactions disconnectpool;
-    while (chainActive.Contains(pindex)) {
+    if (chainActive.Contains(pindex)) {
         pindex_was_in_chain = true;
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+        if (!DisconnectTipsTo(state, chainparams, pindex->pprev, &disconnectpool)) {
             // It's probably hopeless to try to make the mempool consistent
             // here if DisconnectTip failed, but we can try.
             UpdateMempoolForReorg(disconnectpool, false);
@@ -4009,6 +4162,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     CClaimTrieCache trieCache(pclaimTrie);
     CBlockIndex* pindex;
     CBlockIndex* pindexFailure = nullptr;
+    // the claim trie hash is only checked once, after all the disconnected blocks
+    const CBlockIndex* pindexClaimTrie = chainActive.Tip();
     int nGoodTransactions = 0;
     CValidationState state;
     int reportDone = 0;
@@ -4049,7 +4204,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins, trieCache);
+            DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins, trieCache, false);
+            pindexClaimTrie = pindex->pprev;
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -4065,6 +4221,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     }
     if (pindexFailure)
         return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+    if (pindexClaimTrie->hashClaimTrie != trieCache.getMerkleHash())
+        return error("VerifyDB(): *** claim trie inconsistencies found disconnecting down to %d, hash=%s", pindexClaimTrie->nHeight, pindexClaimTrie->GetBlockHash().ToString());
 
     // store block count as we move pindex at check level >= 4
     int block_count = chainActive.Height() - pindex->nHeight;
@@ -14,6 +14,7 @@
 class CBlock;
 class CBlockIndex;
 struct CBlockLocator;
+struct CClaimTrieBlockChanges;
 class CBlockIndex;
 class CConnman;
 class CReserveScript;
@@ -115,6 +116,13 @@ protected:
      * Called on a background thread.
      */
     virtual void BlockDisconnected(const std::shared_ptr<const CBlock> &block) {}
+    /**
+     * Notifies listeners of what a connected or disconnected block changed in the claim trie.
+     * Only sent while fClaimTrieChanges is set, working it out costs a few lookups per name.
+     *
+     * Called on a background thread.
+     */
+    virtual void ClaimTrieChanged(const std::shared_ptr<const CClaimTrieBlockChanges> &changes) {}
     /**
      * Notifies listeners of the new active block chain on-disk.
      *
@@ -181,6 +189,7 @@ public:
     void TransactionAddedToMempool(const CTransactionRef &);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>> &);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &);
+    void ClaimTrieChanged(const std::shared_ptr<const CClaimTrieBlockChanges> &);
     void ChainStateFlushed(const CBlockLocator &);
     void Broadcast(int64_t nBestBlockTime, CConnman* connman);
     void BlockChecked(const CBlock&, const CValidationState&);
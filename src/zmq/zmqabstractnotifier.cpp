@@ -20,3 +20,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyClaimTrie(const CClaimTrieBlockChanges &/*changes*/)
+{
+    return true;
+}
@@ -19,6 +19,7 @@ public:
     virtual ~CZMQNotificationInterface();
 
     std::list<const CZMQAbstractNotifier*> GetActiveNotifiers() const;
+    bool HasNotifier(const std::string& type) const;
 
     static CZMQNotificationInterface* Create();
 
@@ -31,6 +32,7 @@ protected:
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void ClaimTrieChanged(const std::shared_ptr<const CClaimTrieBlockChanges>& changes) override;
 
 private:
     CZMQNotificationInterface();
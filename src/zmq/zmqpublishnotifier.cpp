@@ -4,6 +4,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <claimtrie.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
@@ -16,6 +17,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_CLAIMTRIE = "claimtrie";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -195,3 +197,12 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishClaimTrieNotifier::NotifyClaimTrie(const CClaimTrieBlockChanges &changes)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish claimtrie %s (%s, %u changes)\n", changes.hashBlock.GetHex(),
+             changes.fConnected ? "connected" : "disconnected", changes.changes.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << changes;
+    return SendMessage(MSG_CLAIMTRIE, &(*ss.begin()), ss.size());
+}
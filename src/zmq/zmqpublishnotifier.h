@@ -52,4 +52,10 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishClaimTrieNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyClaimTrie(const CClaimTrieBlockChanges &changes) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# Copyright (c) 2015-2018 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the claimtrie ZMQ notification.
+
+A claim is made in a block and the block is invalidated again: the claimtrie topic should
+carry the claim once for the block being connected and once for it being disconnected."""
+import struct
+from io import BytesIO
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.messages import (
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    deser_compact_size,
+    deser_string,
+    deser_uint256,
+)
+from test_framework.script import CScript, OP_2DROP, OP_DROP, OP_NOP6
+from test_framework.util import (
+    assert_equal,
+    bytes_to_hex_str,
+    hex_str_to_bytes,
+)
+from interface_zmq import ZMQSubscriber
+
+OP_CLAIM_NAME = OP_NOP6
+CLAIM_ADDED = 0
+
+
+def deser_claimtrie_changes(body):
+    f = BytesIO(body)
+    changes = {
+        "hash": "%064x" % deser_uint256(f),
+        "height": struct.unpack("<i", f.read(4))[0],
+        "connected": struct.unpack("<?", f.read(1))[0],
+        "changes": [],
+    }
+    for _ in range(deser_compact_size(f)):
+        change = {"type": struct.unpack("<B", f.read(1))[0], "name": deser_string(f)}
+        f.read(20 + 36)  # the claim id and the outpoint
+        change["amount"], change["effective"] = struct.unpack("<qq", f.read(16))
+        changes["changes"].append(change)
+    assert_equal(f.read(), b"")
+    return changes
+
+
+class ZMQClaimTrieTest (BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_py3_zmq()
+        self.skip_if_no_bitcoind_zmq()
+
+    def setup_nodes(self):
+        import zmq
+
+        address = "tcp://127.0.0.1:28332"
+        self.zmq_context = zmq.Context()
+        self.socket = self.zmq_context.socket(zmq.SUB)
+        self.socket.set(zmq.RCVTIMEO, 60000)
+        self.socket.connect(address)
+        self.claimtrie = ZMQSubscriber(self.socket, b"claimtrie")
+
+        self.add_nodes(self.num_nodes, [["-zmqpubclaimtrie=%s" % address]])
+        self.start_nodes()
+
+    def run_test(self):
+        try:
+            self._zmq_test()
+        finally:
+            self.log.debug("Destroying ZMQ context")
+            self.zmq_context.destroy(linger=None)
+
+    def _zmq_test(self):
+        node = self.nodes[0]
+        address, privkey = node.get_deterministic_priv_key()
+
+        self.log.info("Mine a spendable coinbase, every block is published without changes")
+        hashes = node.generatetoaddress(101, address)
+        # the first blocks can be published before the subscription is through
+        topic, body, seq = self.socket.recv_multipart()
+        assert_equal(topic, b"claimtrie")
+        self.claimtrie.sequence = struct.unpack('<I', seq)[-1] + 1
+        changes = deser_claimtrie_changes(body)
+        while True:
+            assert_equal(changes, {"hash": hashes[changes["height"] - 1], "height": changes["height"], "connected": True, "changes": []})
+            if changes["height"] == len(hashes):
+                break
+            changes = deser_claimtrie_changes(self.claimtrie.receive())
+
+        self.log.info("Claim a name")
+        coinbase = node.getblock(hashes[0])["tx"][0]
+        amount = int(node.gettxout(coinbase, 0)["value"] * 100000000)
+        scriptPubKey = hex_str_to_bytes(node.validateaddress(address)["scriptPubKey"])
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(int(coinbase, 16), 0)))
+        tx.vout.append(CTxOut(amount - 100000, CScript([OP_CLAIM_NAME, b"test", b"value", OP_2DROP, OP_DROP]) + scriptPubKey))
+        signed = node.signrawtransactionwithkey(bytes_to_hex_str(tx.serialize()), [privkey])
+        assert signed["complete"]
+        node.sendrawtransaction(signed["hex"])
+        hash = node.generatetoaddress(1, address)[0]
+
+        changes = deser_claimtrie_changes(self.claimtrie.receive())
+        assert_equal((changes["hash"], changes["height"], changes["connected"]), (hash, 102, True))
+        added = [change for change in changes["changes"] if change["type"] == CLAIM_ADDED]
+        assert_equal(added, [{"type": CLAIM_ADDED, "name": b"test", "amount": amount - 100000, "effective": amount - 100000}])
+
+        self.log.info("Invalidate the block, the claim is published as undone")
+        node.invalidateblock(hash)
+        changes = deser_claimtrie_changes(self.claimtrie.receive())
+        assert_equal((changes["hash"], changes["height"], changes["connected"]), (hash, 102, False))
+        assert [change for change in changes["changes"] if change["type"] == CLAIM_ADDED and change["name"] == b"test"]
+
+
+if __name__ == '__main__':
+    ZMQClaimTrieTest().main()